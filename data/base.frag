@@ -1,10 +1,12 @@
 #version 120
 uniform sampler2D texture;
-varying vec2 vertTexcoord;
+uniform float tileSize;
+varying vec2 vertTexcoord; //in tile space, repeats every block
+varying vec2 vertTile; //upper left corner of the tile in the tileset
 
 void main()
 {
-	gl_FragColor = texture2D(texture, vertTexcoord);
+	gl_FragColor = texture2D(texture, vertTile + fract(vertTexcoord) * tileSize);
 	//vec2 texCoord = gl_TexCoord[0].xy;
 	//vec2 paramU   = gl_TexCoord[1].xy;
 	//vec2 paramV   = gl_TexCoord[2].xy;
@@ -6,15 +6,38 @@ uniform mat4 projectionMatrix;
 uniform mat4 viewMatrix;
 uniform mat4 modelMatrix;
 
-attribute vec3 position;
-attribute vec2 texcoord;
+uniform bool packedVertices; //see chunkVertex_t in chunk.hpp
+uniform float tileSize;
+
+//float vertices: position.xyz in world space, texcoord.xy in tile space, tile the upper left corner of the tile
+//packed vertices: position.xyz relative to chunkOrigin, position.w the face, texcoord.xy in tile space, texcoord.z the tile index
+attribute vec4 position;
+attribute vec4 texcoord;
+attribute vec2 tile;
+attribute vec3 chunkOrigin; //packed vertices only, per draw or per instance, see World::draw
 
 varying vec2 vertTexcoord;
+varying vec2 vertTile;
+
+const float tilesPerRow = 16.0; //TILESET_WIDTH / 16 pixels
+const float tileStride = 1.0 / tilesPerRow; //TILESET_DISPLACEMENT
 
 void main()
 {
-	vertTexcoord = texcoord;
-	vec4 pos = projectionMatrix * viewMatrix * modelMatrix * vec4(position, 1.0f);//, 1.0f);//vec4(gl_Vertex.x, gl_Vertex.y, gl_Vertex.z, 1.0f);
+	vec3 worldPosition;
+	vertTexcoord = texcoord.xy;
+	if(packedVertices)
+	{
+		worldPosition = chunkOrigin + position.xyz;
+		vec2 cell = vec2(mod(texcoord.z, tilesPerRow), floor(texcoord.z / tilesPerRow));
+		vertTile = cell * tileStride + (tileStride - tileSize) * 0.5;
+	}
+	else
+	{
+		worldPosition = position.xyz;
+		vertTile = tile;
+	}
+	vec4 pos = projectionMatrix * viewMatrix * modelMatrix * vec4(worldPosition, 1.0f);//, 1.0f);//vec4(gl_Vertex.x, gl_Vertex.y, gl_Vertex.z, 1.0f);
 	//pos.y += sin(position.y) * 10 * (cos(delta + position.z) / 10) + tan(position.x);
 	//pos.x += sin(delta + position.z);
 	
@@ -3,6 +3,13 @@
 motor::Game::Game()
 {
 	loop = true;
+	settings.fixedSeed = false;
+}
+
+void motor::Game::setSeed(int seed)
+{
+	settings.fixedSeed = true;
+	settings.seed = seed;
 }
 
 glm::vec2 rotate(glm::vec2 point, float angleDeg)
@@ -87,13 +94,13 @@ bool motor::Game::playerColliding()
 	//int maxY = Position.y + size.y / 2;
 	//int maxZ = Position.z + size.z / 2;
 	//AABB    playerBox = AABB(vec3(nx - playerRadius, ny - playerHeight, nz - playerRadius), vec3(nx + playerRadius, ny, nz + playerRadius));
-	int minX = pos.x - size.x / 2;
-	int minY = pos.y - size.y;
-	int minZ = pos.z - size.z / 2;
+	int minX = floor(pos.x - size.x / 2);
+	int minY = floor(pos.y - size.y);
+	int minZ = floor(pos.z - size.z / 2);
 
-	int maxX = pos.x + size.x / 2;
-	int maxY = pos.y;
-	int maxZ = pos.z + size.z / 2;
+	int maxX = floor(pos.x + size.x / 2);
+	int maxY = floor(pos.y);
+	int maxZ = floor(pos.z + size.z / 2);
 
 	for (int x = minX; x <= maxX; x++)
 		for (int y = minY; y <= maxY; y++)
@@ -126,11 +133,11 @@ void motor::Game::handleCollision(glm::vec3 deltaMove, float multiplierMove)
 	AABB playerBox = AABB(vec3(pos.x - playerRadius, pos.y - playerHeight, pos.z - playerRadius), vec3(pos.x + playerRadius, pos.y, pos.z + playerRadius));
 
 	bool collide = false;
-	for(int x = playerBox.min.x; x <= playerBox.max.x; x++)
+	for(int x = floor(playerBox.min.x); x <= playerBox.max.x; x++)
 	{
-		for(int y = playerBox.min.y; y <= playerBox.max.y; y++)
+		for(int y = floor(playerBox.min.y); y <= playerBox.max.y; y++)
 		{
-			for(int z = playerBox.min.z; z <= playerBox.max.z; z++)
+			for(int z = floor(playerBox.min.z); z <= playerBox.max.z; z++)
 			{
 				block_t node = world.getBlock(x, y, z);
 				//AABB nodeBox = getBbOfBlock(vec3(x, y, z));
@@ -159,11 +166,11 @@ void motor::Game::handleCollision(glm::vec3 deltaMove, float multiplierMove)
 		//for(every block directly below playerBox)
 			//if(block.type != air)
 				//falling = false;
-		for(int x = playerBox.min.x; x <= playerBox.max.x; x++)
+		for(int x = floor(playerBox.min.x); x <= playerBox.max.x; x++)
 		{
-			for(int y = playerBox.min.y; y >= (playerBox.min.y) - 0; y--)
+			for(int y = floor(playerBox.min.y); y >= floor(playerBox.min.y) - 0; y--)
 			{
-				for(int z = playerBox.min.z; z <= playerBox.max.z; z++)
+				for(int z = floor(playerBox.min.z); z <= playerBox.max.z; z++)
 				{
 					block_t node = world.getBlock(x, y, z);
 					if(node.type != BLOCK_AIR)
@@ -300,28 +307,20 @@ void motor::Game::handlePlayer()
 
 	if(input->isPressed(Key::BACKSPACE))
 	{
-		world.setBlock(int(pos.x) + 1, int(pos.y), int(pos.z), BLOCK_AIR);
-		world.setBlock(int(pos.x) - 1, int(pos.y), int(pos.z), BLOCK_AIR);
-		world.setBlock(int(pos.x) + 1, int(pos.y) - 1, int(pos.z), BLOCK_AIR);
-		world.setBlock(int(pos.x) - 1, int(pos.y) - 1, int(pos.z), BLOCK_AIR);
-
-		world.setBlock(int(pos.x), int(pos.y), int(pos.z) + 1, BLOCK_AIR);
-		world.setBlock(int(pos.x), int(pos.y), int(pos.z) - 1, BLOCK_AIR);
-		world.setBlock(int(pos.x), int(pos.y) - 1, int(pos.z) + 1, BLOCK_AIR);
-		world.setBlock(int(pos.x), int(pos.y) - 1, int(pos.z) - 1, BLOCK_AIR);
+		//floor, not truncation, the world goes on past 0
+		int x = floor(pos.x), y = floor(pos.y), z = floor(pos.z);
+		world.setBlock(x + 1, y, z, BLOCK_AIR);
+		world.setBlock(x - 1, y, z, BLOCK_AIR);
+		world.setBlock(x + 1, y - 1, z, BLOCK_AIR);
+		world.setBlock(x - 1, y - 1, z, BLOCK_AIR);
+
+		world.setBlock(x, y, z + 1, BLOCK_AIR);
+		world.setBlock(x, y, z - 1, BLOCK_AIR);
+		world.setBlock(x, y - 1, z + 1, BLOCK_AIR);
+		world.setBlock(x, y - 1, z - 1, BLOCK_AIR);
 
 		//world.setBlock(int(pos.x), int(pos.y - 1.6) - 1, int(pos.z), BLOCK_AIR);
-
-		world.recalculateChunck(int(fabs(pos.x)), int(fabs(pos.y)), int(fabs(pos.z)));
-		world.recalculateChunck(int(fabs(pos.x)) - 16, int(fabs(pos.y)), int(fabs(pos.z)));
-		world.recalculateChunck(int(fabs(pos.x)) + 16, int(fabs(pos.y)), int(fabs(pos.z)));
-		world.recalculateChunck(int(fabs(pos.x)), int(fabs(pos.y)), int(fabs(pos.z)) + 16);
-		world.recalculateChunck(int(fabs(pos.x)), int(fabs(pos.y)), int(fabs(pos.z)) - 16);
-
-		world.recalculateChunck(int(fabs(pos.x)) - 16, int(fabs(pos.y)), int(fabs(pos.z)) + 16);
-		world.recalculateChunck(int(fabs(pos.x)) - 16, int(fabs(pos.y)), int(fabs(pos.z)) - 16);
-		world.recalculateChunck(int(fabs(pos.x)) + 16, int(fabs(pos.y)), int(fabs(pos.z)) + 16);
-		world.recalculateChunck(int(fabs(pos.x)) + 16, int(fabs(pos.y)), int(fabs(pos.z)) - 16);
+		//the touched chunks are remeshed by world.flushDirty() once per frame
 	}
 
 }
@@ -335,8 +334,18 @@ int motor::Game::main(Window *wndw, Input *inp, Time *tt)
 	cout << endl;
 
 	float oldTime = time->get();
-	world.load(8, 8, 8, 16, 16, 16); // 128
-	world.generate();
+	world.load(6, 8, 16, 16, 16); //a radius of 6 chunks, 128 blocks high
+	world.setGreedyMeshing(true);
+	world.setCaveCulling(true);
+	world.setLodDistance(64.0f);
+	world.setCaves(true);
+	world.setSaveDirectory("save");
+	if(settings.fixedSeed)
+		world.setSeed(settings.seed);
+	//mapping the snapshot of the last session is bounded by page faults, generating by the noise;
+	//a seed from the command line starts that world, the saved regions continue it if they are from it
+	if(settings.fixedSeed || !world.loadSnapshot("save/snapshot"))
+		world.generate();
 	cout << "world generation took " << time->get() - oldTime << " seconds" << endl;
 	cout << endl;
 
@@ -352,21 +361,32 @@ int motor::Game::main(Window *wndw, Input *inp, Time *tt)
 
 	int texUniform;
 	texUniform = baseShader->getUniformLocation("texture");
+	int tileSizeUniform;
+	tileSizeUniform = baseShader->getUniformLocation("tileSize");
+	int packedVerticesUniform;
+	packedVerticesUniform = baseShader->getUniformLocation("packedVertices");
 
 	int positionAttrib;
 	int texcoordAttrib;
+	int tileAttrib;
+	int chunkOriginAttrib;
 	positionAttrib = baseShader->getAttributeLocation("position");
 	texcoordAttrib = baseShader->getAttributeLocation("texcoord");
+	tileAttrib = baseShader->getAttributeLocation("tile");
+	chunkOriginAttrib = baseShader->getAttributeLocation("chunkOrigin");
 
 	baseShader->activate();
 
 	camera = new Camera(input, baseShader);
 	camera->setPerspective(45.0f, float(window->width) / float(window->height), window->near, window->far);
 	camera->position = glm::vec3(0, 0, 0);
+	world.setCamera(camera);
 
 	cout << endl;
 
 	glUniform1i(texUniform, 0);
+	glUniform1f(tileSizeUniform, TILE_SIZE);
+	glUniform1i(packedVerticesUniform, CHUNK_PACKED);
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, tileset->data);
 
@@ -412,12 +432,24 @@ int motor::Game::main(Window *wndw, Input *inp, Time *tt)
 			cout << "regenerating" << endl;
 		}
 
+		if(input->isPressed(Key::B) && input->getKeyDelay(Key::B) > .5f)
+		{
+			input->resetKeyDelay(Key::B);
+			world.benchmark();
+		}
+
 		camera->think();
 
+		world.stream(camera->position);
+		world.flushDirty();
+		world.uploadMeshes();
+
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		world.draw(positionAttrib, texcoordAttrib);
+		world.draw(positionAttrib, texcoordAttrib, tileAttrib, chunkOriginAttrib);
 		SDL_GL_SwapBuffers();
 	}
+	world.save();
+	world.saveSnapshot("save/snapshot");
 	return 0;
 }
 void motor::Game::update()
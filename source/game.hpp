@@ -36,6 +36,7 @@ namespace motor
 	{
 		public:
 			Game();
+			void setSeed(int seed);//of the world, instead of the saved one or a new one
 			int main(Window*, Input*, Time*);
 			void init();
 			void load();
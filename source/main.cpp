@@ -1,4 +1,6 @@
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
 using namespace std;
 
 #include "motor/graphics/window.hpp"
@@ -18,6 +20,9 @@ int main(int argc, char **argv)
 	Time *time = new Time();
 
 	Game *current = new Game();
+	for(int i = 1; i + 1 < argc; i++)
+		if(strcmp(argv[i], "-seed") == 0)
+			current->setSeed(atoi(argv[++i]));
 	current->main(window, keys, time);
 
 	delete current;
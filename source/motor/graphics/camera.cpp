@@ -6,6 +6,10 @@ motor::Camera::Camera(Input *inputPtr, Shader *shaderPtr)
 	shader = shaderPtr;
 	modelMatrix = glm::mat4(1.0f);
 	viewMatrix = glm::mat4(1.0f);
+	viewProjectionMatrix = glm::mat4(1.0f);
+	//all zero planes let everything through until the first think()
+	for(unsigned int i = 0; i < 6; i++)
+		frustumPlanes[i] = glm::vec4(0.0f);
 
 	projectionMatrixUniform = shader->getUniformLocation("projectionMatrix");
 	viewMatrixUniform = shader->getUniformLocation("viewMatrix");
@@ -166,4 +170,33 @@ void motor::Camera::think()
 	glUniformMatrix4fv(projectionMatrixUniform, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
 	glUniformMatrix4fv(viewMatrixUniform, 1, GL_FALSE, glm::value_ptr(tm));
 	glUniformMatrix4fv(modelMatrixUniform, 1, GL_FALSE, glm::value_ptr(modelMatrix));
+
+	viewProjectionMatrix = projectionMatrix * tm * modelMatrix;
+	extractFrustumPlanes(viewProjectionMatrix, frustumPlanes);
+}
+
+const glm::vec4* motor::Camera::getFrustumPlanes()
+{
+	return frustumPlanes;
+}
+
+void motor::Camera::extractFrustumPlanes(const glm::mat4 &viewProjection, glm::vec4 planes[6])
+{
+	//-w <= x, y, z <= w in clip space, so each plane is the last row plus or minus one of the others
+	//(glm is column major, m[column][row])
+	glm::vec4 rows[4];
+	for(unsigned int r = 0; r < 4; r++)
+		rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+
+	for(unsigned int i = 0; i < 3; i++)
+	{
+		planes[i * 2] = rows[3] + rows[i];
+		planes[i * 2 + 1] = rows[3] - rows[i];
+	}
+	for(unsigned int i = 0; i < 6; i++)
+	{
+		float length = glm::length(glm::vec3(planes[i]));
+		if(length > 0)
+			planes[i] /= length;
+	}
 }
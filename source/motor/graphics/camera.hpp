@@ -36,6 +36,11 @@ namespace motor
 
 			void think();
 
+			//of the last think(), in world space, xyz the normal pointing inside and w the distance
+			//in left, right, bottom, top, near, far order
+			const glm::vec4* getFrustumPlanes();
+			static void extractFrustumPlanes(const glm::mat4 &viewProjection, glm::vec4 planes[6]);
+
 			glm::vec3 position;
 			glm::vec3 rotation;
 		private:
@@ -46,6 +51,8 @@ namespace motor
 			glm::mat4 projectionMatrix;
 			glm::mat4 viewMatrix;
 			glm::mat4 modelMatrix;
+			glm::mat4 viewProjectionMatrix;
+			glm::vec4 frustumPlanes[6];
 
 			int projectionMatrixUniform;
 			int viewMatrixUniform;
@@ -1,35 +1,174 @@
 #include "chunk.hpp"
+#include <cstring>
+#include <stdint.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "motor/graphics/world.hpp" //"hack" for circular dependency
 
-motor::Chunk::Chunk(){}
+motor::Chunk::Chunk()
+{
+	voxels = NULL;
+	voxelsMapped = false;
+	bitsPerBlock = bitsShift = 0;
+	vertexCount = uploadedVertexCount = 0;
+	voxelCount = 0;
+	connectivity = meshConnectivity = ~uint64_t(0);
+	lod = 0;
+	dirty = false;
+	memoryAllocationRam = memoryAllocationGfx = memoryAllocationMesh = 0;
+}
 
 motor::Chunk::Chunk(unsigned int xDim, unsigned int yDim, unsigned int zDim)
 {
+	voxels = NULL;
+	voxelsMapped = false;
+	bitsPerBlock = bitsShift = 0;
+	init(xDim, yDim, zDim);
+}
+
+motor::Chunk::~Chunk()
+{
+	releaseVoxels();
+}
+
+void motor::Chunk::init(unsigned int xDim, unsigned int yDim, unsigned int zDim)
+{
+	if(xDim > CHUNK_MAX_SIZE || yDim > CHUNK_MAX_SIZE || zDim > CHUNK_MAX_SIZE)
+	{
+		cout << "Chunks can be at most " << CHUNK_MAX_SIZE << " blocks in each direction, clamping\n";
+		xDim = min(xDim, CHUNK_MAX_SIZE);
+		yDim = min(yDim, CHUNK_MAX_SIZE);
+		zDim = min(zDim, CHUNK_MAX_SIZE);
+	}
+
 	xSize = xDim;
 	ySize = yDim;
 	zSize = zDim;
-	vertexCount = 0;
-	vertexBuffer = 0;
-	vertices = NULL;
+	vertexCount = uploadedVertexCount = 0;
+	connectivity = meshConnectivity = ~uint64_t(0); //everything connects until the first mesh says otherwise
+	lod = 0;
+	memoryAllocationGfx = memoryAllocationMesh = 0;
+	dirty = false;
+
+#ifdef CHUNK_LAYOUT_MORTON
+	//the z-order curve spans a cube with power of two edges
+	unsigned int edge = 1;
+	while(edge < xDim || edge < yDim || edge < zDim)
+		edge <<= 1;
+	voxelCount = edge * edge * edge;
+#else
+	voxelCount = xDim * yDim * zDim;
+#endif
+
+	//a fresh chunk is uniform air: a single palette entry and no voxels until something else is set
+	palette.assign(1, BLOCK_AIR);
+	releaseVoxels();
+	bitsPerBlock = bitsShift = 0;
+	updateMemoryAllocation();
+}
+
+//zeroed, NULL if it could not be allocated
+static unsigned char* allocateVoxels(unsigned int bytes)
+{
+	unsigned char *packed = NULL;
 
-	voxels = new block_t**[xDim];
-	for(unsigned int i = 0; i < xDim; i++)
+	//align to a cache line so a chunk never shares its first and last line with other data
+	if(posix_memalign((void**)&packed, 64, bytes) != 0)
 	{
-		voxels[i] = new block_t*[yDim];
-		for(unsigned int j = 0; j < yDim; j++)
+		cout << "Unable to allocate " << bytes << " bytes for chunk voxels\n";
+		return NULL;
+	}
+	memset(packed, 0, bytes);
+	return packed;
+}
+
+bool motor::Chunk::repack(unsigned int bits)
+{
+	unsigned char *packed = allocateVoxels((voxelCount * bits + 7) / 8);
+	if(packed == NULL)
+		return false;
+
+	unsigned char *old = voxels;
+	unsigned int oldBits = bitsPerBlock, oldShift = bitsShift;
+	bool oldMapped = voxelsMapped;
+
+	voxels = packed;
+	voxelsMapped = false;
+	bitsPerBlock = bits;
+	bitsShift = 0;
+	while((1u << bitsShift) < bits)
+		bitsShift++;
+
+	if(old != NULL)
+	{
+		unsigned int oldPerByteShift = 3 - oldShift;
+		unsigned char oldMask = (1 << oldBits) - 1;
+		for(unsigned int i = 0; i < voxelCount; i++)
 		{
-			voxels[i][j] = new block_t[zDim];
-			for(unsigned int k = 0; k < zDim; k++)
-			{
-				voxels[i][j][k] = block_t(BLOCK_AIR, 0);
-			}
+			unsigned int shift = (i & ((1 << oldPerByteShift) - 1)) << oldShift;
+			setIndex(i, (old[i >> oldPerByteShift] >> shift) & oldMask);
 		}
+		if(!oldMapped)
+			free(old);
+	}
+
+	updateMemoryAllocation();
+	return true;
+}
+
+void motor::Chunk::releaseVoxels()
+{
+	if(!voxelsMapped)
+		free(voxels);
+	voxels = NULL;
+	voxelsMapped = false;
+}
+
+void motor::Chunk::mapVoxels(unsigned char *packed, unsigned int bits, const unsigned char *types, unsigned int paletteSize)
+{
+	releaseVoxels();
+	palette.assign(types, types + paletteSize);
+	bitsPerBlock = bitsShift = 0;
+	if(bits == 0)
+	{
+		updateMemoryAllocation();
+		return;
 	}
+	voxels = packed;
+	voxelsMapped = true;
+	bitsPerBlock = bits;
+	while((1u << bitsShift) < bits)
+		bitsShift++;
+	updateMemoryAllocation();
+}
+
+const unsigned char* motor::Chunk::getVoxels()
+{
+	return voxels;
+}
+
+unsigned int motor::Chunk::getVoxelBytes()
+{
+	return (voxelCount * bitsPerBlock + 7) / 8;
+}
+
+unsigned int motor::Chunk::getVoxelCount()
+{
+	return voxelCount;
+}
 
-	memoryAllocationRam = sizeof(block_t) * xDim * yDim * zDim;
+const unsigned char* motor::Chunk::getPalette()
+{
+	return &palette[0];
 }
 
-motor::Chunk::~Chunk(){}
+void motor::Chunk::updateMemoryAllocation()
+{
+	memoryAllocationRam = (voxelCount * bitsPerBlock + 7) / 8 + palette.capacity();
+}
 
 void motor::Chunk::setWorldRef(World *wrld)
 {
@@ -38,267 +177,738 @@ void motor::Chunk::setWorldRef(World *wrld)
 
 void motor::Chunk::set(glm::ivec3 &coord, unsigned short blockType)
 {
-	voxels[coord.x][coord.y][coord.z].type = blockType;
+	set(coord.x, coord.y, coord.z, blockType);
 }
 
 void motor::Chunk::set(unsigned int x, unsigned int y, unsigned int z, unsigned short blockType)
 {
-	voxels[x][y][z].type = blockType;
+	if(blockType >= CHUNK_MAX_PALETTE)
+	{
+		cout << "Block type " << blockType << " does not fit into a chunk palette\n";
+		return;
+	}
+
+	unsigned int p = 0;
+	while(p < palette.size() && palette[p] != blockType)
+		p++;
+
+	//a full palette of different types has every one, so one that is missing means there are
+	//duplicates, e.g. from a snapshot, and compacting makes room
+	if(p == palette.size() && palette.size() == CHUNK_MAX_PALETTE)
+	{
+		compact();
+		p = 0;
+		while(p < palette.size() && palette[p] != blockType)
+			p++;
+	}
+
+	if(p == palette.size())
+	{
+		palette.push_back(blockType);
+		if(palette.size() > (1u << bitsPerBlock))
+		{
+			//out of memory, the chunk stays as it was
+			if(!repack(bitsPerBlock ? bitsPerBlock * 2 : 1))
+			{
+				palette.pop_back();
+				return;
+			}
+		}
+		else
+			updateMemoryAllocation();
+	}
+	else if(bitsPerBlock == 0)
+		return; //uniform and already of this type
+
+	setIndex(index(x, y, z), p);
 }
 
-motor::block_t& motor::Chunk::get(glm::ivec3 &coord)
+motor::block_t motor::Chunk::get(glm::ivec3 &coord)
 {
 	return get(coord.x, coord.y, coord.z);
 }
 
-//motor::block_t motor::Chunk::get(unsigned int x, unsigned int y, unsigned int z)
-motor::block_t& motor::Chunk::get(int x, int y, int z)
+motor::block_t motor::Chunk::get(int x, int y, int z)
 {
+	//outside of the chunk the world looks it up in the neighbor, BLOCK_OOB where none is loaded
 	if((x >= xSize || y >= ySize || z >= zSize) || (x < 0 || y < 0 || z < 0))
-	{
-		//TODO 
-		//-insert code for finding block in other chunk here
-		//-make parameters signed
-		//
-		//world.get(xOff + x, ...
-		//xOff is the number of blocks offset 
-		//cout << "stepping out to world\n";
 		return world->getBlock(xOff + x, yOff + y, zOff + z);
-		//return block_t(BLOCK_DIRT, 0);
+	return block_t(palette[getIndex(index(x, y, z))], 0);
+}
+
+void motor::Chunk::getAll(unsigned char *types) const
+{
+	if(bitsPerBlock == 0)
+	{
+		memset(types, palette[0], xSize * ySize * zSize);
+		return;
 	}
-	return voxels[x][y][z];
+#ifdef CHUNK_LAYOUT_MORTON
+	for(int x = 0; x < xSize; x++)
+		for(int z = 0; z < zSize; z++)
+			for(int y = 0; y < ySize; y++)
+				*types++ = palette[getIndex(index(x, y, z))];
+#else
+	//storage order equals the output order, so decode a whole packed byte at once:
+	//expand[b] holds the block types of the 8 / bitsPerBlock indices in byte b
+	unsigned int perByte = 8 / bitsPerBlock;
+	unsigned char mask = (1 << bitsPerBlock) - 1;
+	unsigned char expand[256][8];
+	for(unsigned int b = 0; b < 256; b++)
+		for(unsigned int n = 0; n < perByte; n++)
+		{
+			unsigned char p = (b >> (n * bitsPerBlock)) & mask;
+			expand[b][n] = p < palette.size() ? palette[p] : BLOCK_AIR;
+		}
+
+	unsigned int fullBytes = voxelCount / perByte;
+	for(unsigned int i = 0; i < fullBytes; i++, types += perByte)
+		memcpy(types, expand[voxels[i]], perByte);
+	for(unsigned int i = fullBytes * perByte; i < voxelCount; i++)
+		*types++ = palette[getIndex(i)];
+#endif
 }
 
-unsigned int motor::Chunk::calculateVisibleSides(unsigned int xOff, unsigned int yOff, unsigned int zOff, bool mergeFaces)
+void motor::Chunk::setAll(const unsigned char *types)
 {
-	this->xOff = xOff;
-	this->yOff = yOff;
-	this->zOff = zOff;
+	//build the palette from scratch, so types that are gone get dropped
+	unsigned int count = xSize * ySize * zSize;
+	short lookup[256];
+	for(unsigned int i = 0; i < 256; i++)
+		lookup[i] = -1;
+
+	vector<unsigned char> used;
+	for(unsigned int i = 0; i < count; i++)
+		if(lookup[types[i]] < 0)
+		{
+			lookup[types[i]] = used.size();
+			used.push_back(types[i]);
+		}
+
+	//the new voxels first, out of memory the chunk keeps its blocks
+	unsigned int bits = 0;
+	unsigned char *packed = NULL;
+	if(used.size() > 1)
+	{
+		bits = 1;
+		while((1u << bits) < used.size())
+			bits *= 2;
+		packed = allocateVoxels((voxelCount * bits + 7) / 8);
+		if(packed == NULL)
+			return;
+	}
 
-	memoryAllocationGfx = 0;
+	releaseVoxels();
+	palette.swap(used);
+	voxels = packed;
+	bitsPerBlock = bits;
+	bitsShift = 0;
+	while((1u << bitsShift) < bits)
+		bitsShift++;
+	updateMemoryAllocation();
+	if(bits == 0)
+		return;
 
-	vertexCount = 0;
-	unsigned int steps = 0;
 	for(int x = 0; x < xSize; x++)
-		for(int y = 0; y < ySize; y++)
+		for(int z = 0; z < zSize; z++)
+			for(int y = 0; y < ySize; y++)
+				setIndex(index(x, y, z), lookup[*types++]);
+}
+
+unsigned int motor::Chunk::getBitsPerBlock()
+{
+	return bitsPerBlock;
+}
+
+unsigned int motor::Chunk::getPaletteSize()
+{
+	return palette.size();
+}
+
+bool motor::Chunk::isUniform()
+{
+	return bitsPerBlock == 0;
+}
+
+void motor::Chunk::compact()
+{
+	if(bitsPerBlock == 0)
+		return;
+	vector<unsigned char> types(xSize * ySize * zSize);
+	getAll(&types[0]);
+	setAll(&types[0]);
+}
+
+//the six faces of a block in the order they are emitted, with the axis of the normal and its direction,
+//the axes the texture u and v run along and the corners of the unit quad
+//in lower left, lower right, upper right, upper left order (see blockTexCoordEnum)
+struct chunkFace_t
+{
+	int axis, sign, u, v;
+	int corners[4][3];
+};
+
+static const chunkFace_t chunkFaces[6] =
+{
+	{0,  1, 2, 1, {{1, 0, 0}, {1, 0, 1}, {1, 1, 1}, {1, 1, 0}}},//right
+	{0, -1, 2, 1, {{0, 0, 1}, {0, 0, 0}, {0, 1, 0}, {0, 1, 1}}},//left
+	{1, -1, 0, 2, {{0, 0, 1}, {1, 0, 1}, {1, 0, 0}, {0, 0, 0}}},//bottom
+	{2,  1, 0, 1, {{1, 0, 1}, {0, 0, 1}, {0, 1, 1}, {1, 1, 1}}},//z + 1
+	{1,  1, 0, 2, {{0, 1, 0}, {1, 1, 0}, {1, 1, 1}, {0, 1, 1}}},//top
+	{2, -1, 0, 1, {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}}} //z - 1
+};
+
+//axes the u and v of the faces along each axis run along, matches chunkFaces
+static const int columnU[3] = {2, 0, 0};
+static const int columnV[3] = {1, 2, 1};
+
+//visible = solid & ~neighbor for every column, the neighbor along a positive normal is the next bit
+static void cullColumns(const uint64_t *solid, uint64_t *visible, unsigned int count, int sign, uint64_t interior)
+{
+	unsigned int i = 0;
+#if defined(__AVX2__)
+	__m256i interior4 = _mm256_set1_epi64x(interior);
+	for(; i + 4 <= count; i += 4)
+	{
+		__m256i c = _mm256_loadu_si256((const __m256i*)(solid + i));
+		__m256i n = sign > 0 ? _mm256_srli_epi64(c, 1) : _mm256_slli_epi64(c, 1);
+		_mm256_storeu_si256((__m256i*)(visible + i), _mm256_and_si256(_mm256_andnot_si256(n, c), interior4));
+	}
+#elif defined(__SSE2__)
+	__m128i interior2 = _mm_set1_epi64x(interior);
+	for(; i + 2 <= count; i += 2)
+	{
+		__m128i c = _mm_loadu_si128((const __m128i*)(solid + i));
+		__m128i n = sign > 0 ? _mm_srli_epi64(c, 1) : _mm_slli_epi64(c, 1);
+		_mm_storeu_si128((__m128i*)(visible + i), _mm_and_si128(_mm_andnot_si128(n, c), interior2));
+	}
+#endif
+	for(; i < count; i++)
+	{
+		uint64_t n = sign > 0 ? solid[i] >> 1 : solid[i] << 1;
+		visible[i] = solid[i] & ~n & interior;
+	}
+}
+
+void motor::Chunk::fillPadded(unsigned char *padded)
+{
+	int xPad = xSize + 2, yPad = ySize + 2, zPad = zSize + 2;
+	int size[3] = {xSize, ySize, zSize};
+
+	//edges and corners of the border are never looked at, only the six slabs next to the faces
+	if(bitsPerBlock == 0)
+		memset(padded, palette[0], xPad * yPad * zPad); //the slabs get overwritten below
+	else
+	{
+		memset(padded, BLOCK_AIR, xPad * yPad * zPad);
+		vector<unsigned char> types(xSize * ySize * zSize);
+		getAll(&types[0]);
+		for(int x = 0; x < xSize; x++)
 			for(int z = 0; z < zSize; z++)
-			{
-				//				cout << (int)get(x+1, y, z).type << " ";
-				if(get(x,y,z).type != BLOCK_AIR)
-				{
-					//7				6					5			4		 3			2	   1   0
-					//visible	handled?	right	left bottom back top front
-					get(x,y,z).visible = 0b00000000;
+				memcpy(&padded[((x + 1) * zPad + z + 1) * yPad + 1], &types[(x * zSize + z) * ySize], ySize);
+	}
 
-					//right
-					if(get(x+1, y, z).type == BLOCK_AIR)// || get(x+1, y, z).visible == 0)
-					{
-						get(x,y,z).visible |= 0b10100000;
-						steps++;
-						vertexCount += 4;
+	int chunkCoord[3] = {xOff / xSize, yOff / ySize, zOff / zSize};
+	for(unsigned int f = 0; f < 6; f++)
+	{
+		const chunkFace_t &face = chunkFaces[f];
+		int n[3] = {chunkCoord[0], chunkCoord[1], chunkCoord[2]};
+		n[face.axis] += face.sign;
+		Chunk *neighbor = world->getChunk(n[0], n[1], n[2]);
 
-						memoryAllocationGfx += sizeof(float) * 4;
-					}
-					//left
-					if(get(x-1, y, z).type == BLOCK_AIR)// || get(x-1, y, z).visible == 0)
-					{
-						get(x,y,z).visible |= 0b10010000;
-						steps++;
-						vertexCount += 4;
+		//outside of the world counts as solid, like World::getBlock,
+		//a neighbor at another level of detail as air so the faces along it form a skirt
+		int fill = -1;
+		if(neighbor == NULL)
+			fill = BLOCK_OOB;
+		else if(neighbor->lod != lod)
+			fill = BLOCK_AIR;
+		else if(neighbor->bitsPerBlock == 0)
+			fill = neighbor->palette[0];
 
-						memoryAllocationGfx += sizeof(float) * 4;
-					}
-					//bottom
-					if(get(x, y-1, z).type == BLOCK_AIR)// || get(x, y-1, z).visible == 0)
-					{
-						get(x,y,z).visible |= 0b10001000;
-						steps++;
-						vertexCount += 4;
+		//the slab straight from the packed indices of the neighbor
+		int p[3], q[3]; //position in the padded volume and in the neighbor
+		p[face.axis] = face.sign > 0 ? size[face.axis] + 1 : 0;
+		q[face.axis] = face.sign > 0 ? 0 : size[face.axis] - 1;
+		for(int v = 0; v < size[face.v]; v++)
+			for(int u = 0; u < size[face.u]; u++)
+			{
+				p[face.u] = u + 1;
+				p[face.v] = v + 1;
+				q[face.u] = u;
+				q[face.v] = v;
+				padded[(p[0] * zPad + p[2]) * yPad + p[1]] = fill >= 0 ? fill : neighbor->palette[neighbor->getIndex(neighbor->index(q[0], q[1], q[2]))];
+			}
+	}
+}
 
-						memoryAllocationGfx += sizeof(float) * 4;
-					}
-					//back
-					if(get(x, y, z-1).type == BLOCK_AIR)// || get(x, y, z-1).visible == 0)
-					{
-						get(x,y,z).visible |= 0b10000100;
-						steps++;
-						vertexCount += 4;
+//solid if at least half of the blocks are, with the type of the highest solid block so surfaces keep
+//their look, blocks are given layer by layer from the bottom
+static unsigned char downsampleCell(const unsigned char *blocks, int count)
+{
+	int solid = 0;
+	for(int i = 0; i < count; i++)
+		if(blocks[i] != motor::BLOCK_AIR)
+			solid++;
+	if(solid * 2 < count)
+		return motor::BLOCK_AIR;
+	for(int i = count - 1; i > 0; i--)
+		if(blocks[i] != motor::BLOCK_AIR)
+			return blocks[i];
+	return blocks[0];
+}
 
-						memoryAllocationGfx += sizeof(float) * 4;
-					}
-					//top
-					if(get(x, y+1, z).type == BLOCK_AIR)// || get(x, y+1, z).visible == 0)
-					{
-						get(x,y,z).visible |= 0b10000010;
-						steps++;
-						vertexCount += 4;
+void motor::Chunk::fillPaddedLod(const unsigned char *padded, unsigned char *lodPadded)
+{
+	int scale = 1 << lod;
+	int size[3] = {xSize >> lod, ySize >> lod, zSize >> lod};
+	int yPad = ySize + 2, zPad = zSize + 2;
+	int yLod = size[1] + 2, zLod = size[2] + 2;
+	unsigned char blocks[8 * 8 * 8];
 
-						memoryAllocationGfx += sizeof(float) * 4;
-					}
-					//front
-					if(get(x, y, z+1).type == BLOCK_AIR)// || get(x, y, z+1).visible == 0)
-					{
-						get(x,y,z).visible |= 0b10000001;
-						steps++;
-						vertexCount += 4;
+	memset(lodPadded, BLOCK_AIR, (size[0] + 2) * yLod * zLod);
+	for(int x = 0; x < size[0]; x++)
+		for(int z = 0; z < size[2]; z++)
+			for(int y = 0; y < size[1]; y++)
+			{
+				int n = 0;
+				for(int by = 0; by < scale; by++)
+					for(int bx = 0; bx < scale; bx++)
+						for(int bz = 0; bz < scale; bz++)
+							blocks[n++] = padded[((x * scale + bx + 1) * zPad + z * scale + bz + 1) * yPad + y * scale + by + 1];
+				lodPadded[((x + 1) * zLod + z + 1) * yLod + y + 1] = downsampleCell(blocks, n);
+			}
 
-						memoryAllocationGfx += sizeof(float) * 4;
-					}
+	//the border cells are downsampled from the first layers of the neighbors, like they do it themselves
+	int chunkCoord[3] = {xOff / xSize, yOff / ySize, zOff / zSize};
+	for(unsigned int f = 0; f < 6; f++)
+	{
+		const chunkFace_t &face = chunkFaces[f];
+		int c[3] = {chunkCoord[0], chunkCoord[1], chunkCoord[2]};
+		c[face.axis] += face.sign;
+		Chunk *neighbor = world->getChunk(c[0], c[1], c[2]);
+
+		int p[3], q[3]; //cell in the downsampled volume and its first block in the neighbor
+		p[face.axis] = face.sign > 0 ? size[face.axis] + 1 : 0;
+		q[face.axis] = face.sign > 0 ? 0 : (face.axis == 0 ? xSize : face.axis == 1 ? ySize : zSize) - scale;
+		for(int v = 0; v < size[face.v]; v++)
+			for(int u = 0; u < size[face.u]; u++)
+			{
+				p[face.u] = u + 1;
+				p[face.v] = v + 1;
+				q[face.u] = u * scale;
+				q[face.v] = v * scale;
+				unsigned char &cell = lodPadded[(p[0] * zLod + p[2]) * yLod + p[1]];
+				if(neighbor == NULL)
+					cell = BLOCK_OOB;
+				else if(neighbor->lod != lod)
+					cell = BLOCK_AIR;
+				else
+				{
+					int n = 0;
+					for(int by = 0; by < scale; by++)
+						for(int bx = 0; bx < scale; bx++)
+							for(int bz = 0; bz < scale; bz++)
+								blocks[n++] = neighbor->get(q[0] + bx, q[1] + by, q[2] + bz).type;
+					cell = downsampleCell(blocks, n);
 				}
 			}
+	}
+}
+
+//solid occupancy of a padded volume as one word per column along each axis, bit i is block i - 1
+//of the column, the column for axis a at (u, v) of its faces is columns[a][v * padSize[u] + u]
+static void buildColumns(const unsigned char *padded, const int padSize[3], vector<uint64_t> columns[3])
+{
+	int yPad = padSize[1], zPad = padSize[2];
+	for(unsigned int a = 0; a < 3; a++)
+		columns[a].assign(padSize[columnU[a]] * padSize[columnV[a]], 0);
+	for(int x = 0; x < padSize[0]; x++)
+		for(int z = 0; z < padSize[2]; z++)
+		{
+			const unsigned char *column = &padded[(x * zPad + z) * yPad];
+			uint64_t *xColumns = &columns[0][z];
+			uint64_t *zColumns = &columns[2][x];
+			uint64_t yColumn = 0;
+			for(int y = 0; y < padSize[1]; y++)
+				if(column[y] != motor::BLOCK_AIR)
+				{
+					yColumn |= uint64_t(1) << y;
+					xColumns[y * padSize[2]] |= uint64_t(1) << x;
+					zColumns[y * padSize[0]] |= uint64_t(1) << z;
+				}
+			columns[1][z * padSize[0] + x] = yColumn;
+		}
+}
 
-	vertices = new vertex_t[vertexCount];
+bool motor::Chunk::isEnclosed()
+{
+	if(bitsPerBlock != 0 || palette[0] == BLOCK_AIR)
+		return false;
 
-	unsigned int currentVertex = 0;
-	for(int x = 0; x < xSize; x++)
-		for(int y = 0; y < ySize; y++)
-			for(int z = 0; z < zSize; z++)
+	int chunkCoord[3] = {xOff / xSize, yOff / ySize, zOff / zSize};
+	for(unsigned int f = 0; f < 6; f++)
+	{
+		int n[3] = {chunkCoord[0], chunkCoord[1], chunkCoord[2]};
+		n[chunkFaces[f].axis] += chunkFaces[f].sign;
+		Chunk *neighbor = world->getChunk(n[0], n[1], n[2]);
+		//outside of the world counts as solid
+		if(neighbor && (neighbor->bitsPerBlock != 0 || neighbor->palette[0] == BLOCK_AIR))
+			return false;
+	}
+	return true;
+}
+
+unsigned int motor::Chunk::calculateVisibleSides(int xOff, int yOff, int zOff, bool greedy, MeshStaging *staging)
+{
+	this->xOff = xOff;
+	this->yOff = yOff;
+	this->zOff = zOff;
+
+	//uniform air has no faces at all, uniform solid only where a neighbor is not uniform solid
+	if((bitsPerBlock == 0 && palette[0] == BLOCK_AIR) || isEnclosed())
+	{
+		meshConnectivity = palette[0] == BLOCK_AIR ? ~uint64_t(0) : 0;
+		vertices.clear();
+		vertexCount = 0;
+		memoryAllocationMesh = vertices.capacity() * sizeof(chunkVertex_t);
+		return 0;
+	}
+
+	meshScratch_t ownScratch;
+	meshScratch_t *scratch = staging ? staging->acquire() : &ownScratch;
+	if(staging && vertices.capacity() == 0)
+		staging->take(vertices);
+
+	//the chunk with a one block border from its neighbors, in linear xzy order,
+	//so the face tests below need neither bounds checks nor world lookups
+	int yPad = ySize + 2, zPad = zSize + 2;
+	vector<unsigned char> &padded = scratch->padded;
+	padded.resize((xSize + 2) * yPad * zPad);
+	fillPadded(&padded[0]);
+	int size[3] = {xSize, ySize, zSize};
+	int padSize[3] = {xSize + 2, ySize + 2, zSize + 2};
+	vector<uint64_t> *columns = scratch->columns;
+	buildColumns(&padded[0], padSize, columns);
+	calculateConnectivity(&columns[1][0], scratch);
+
+	//distant chunks are meshed from a downsampled copy, with every block scale times as large
+	const unsigned char *volume = &padded[0];
+	int scale = 1 << lod;
+	if(lod > 0)
+	{
+		for(unsigned int a = 0; a < 3; a++)
+		{
+			size[a] >>= lod;
+			padSize[a] = size[a] + 2;
+		}
+		yPad = padSize[1];
+		zPad = padSize[2];
+		scratch->lodPadded.resize(padSize[0] * yPad * zPad);
+		fillPaddedLod(&padded[0], &scratch->lodPadded[0]);
+		volume = &scratch->lodPadded[0];
+		buildColumns(volume, padSize, columns);
+	}
+	int stride[3] = {zPad * yPad, 1, yPad};
+
+	vertices.clear();
+	vector<uint64_t> &visible = scratch->visible;
+	vector<unsigned char> &masks = scratch->masks;
+	vector<bool> &sliceUsed = scratch->sliceUsed;
+	for(unsigned int f = 0; f < 6; f++)
+	{
+		const chunkFace_t &face = chunkFaces[f];
+		int sliceCount = size[face.axis], uCount = size[face.u], vCount = size[face.v];
+		int uPad = padSize[face.u];
+
+		//a face is visible where a block is solid and its neighbor along the normal is not,
+		//for a whole column at once, minus the border blocks that belong to the neighbors
+		const vector<uint64_t> &solid = columns[face.axis];
+		visible.resize(solid.size());
+		uint64_t interior = ((uint64_t(1) << sliceCount) - 1) << 1;
+		cullColumns(&solid[0], &visible[0], solid.size(), face.sign, interior);
+
+		//scatter the visible faces into one mask per slice perpendicular to the normal,
+		//masks holds the block type of every visible face (0 = no face)
+		masks.assign(sliceCount * uCount * vCount, BLOCK_AIR);
+		sliceUsed.assign(sliceCount, false);
+		for(int v = 0; v < vCount; v++)
+			for(int u = 0; u < uCount; u++)
 			{
-				//				cout << (int)get(x+1, y, z).type << " ";
-				if(get(x,y,z).type != BLOCK_AIR)//we dont need to check air blocks, you dont see them anyway ;)
+				uint64_t bits = visible[(v + 1) * uPad + u + 1];
+				int base = (u + 1) * stride[face.u] + (v + 1) * stride[face.v];
+				while(bits)
 				{
-					glm::vec3 pos = glm::vec3(x + xOff, y + yOff, z + zOff);
-					//7				6	5			4		 3			2	   1   0
-					//visible		right	left bottom back top front
-					//get(x,y,z).visible = 0b10000000;
+					int b = __builtin_ctzll(bits);
+					bits &= bits - 1;
+					masks[((b - 1) * vCount + v) * uCount + u] = volume[base + b * stride[face.axis]];
+					sliceUsed[b - 1] = true;
+				}
+			}
 
-					//right
-					if(get(x+1, y, z).type == BLOCK_AIR)// || get(x+1, y, z).visible == 0)
-					{
-						//get(x,y,z).visible |= 0b10100000;
-						steps++;
-						//vertices[currentVertex++] = vertex_t(glm::vec3( .5f,-.5f, 0.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERLEFT]);//near lower
-						//vertices[currentVertex++] = vertex_t(glm::vec3( .5f,-.5f,-1.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERRIGHT]);//far lower
-						//vertices[currentVertex++] = vertex_t(glm::vec3( .5f, .5f,-1.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERRIGHT]);//far upper
-						//vertices[currentVertex++] = vertex_t(glm::vec3( .5f, .5f, 0.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERLEFT]);//near upper
-						vertices[currentVertex++] = vertex_t(glm::vec3( 1.f, 0.f, 0.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERLEFT]);//far left
-						vertices[currentVertex++] = vertex_t(glm::vec3( 1.f, 0.f, 1.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERRIGHT]);//far right
-						vertices[currentVertex++] = vertex_t(glm::vec3( 1.f, 1.f, 1.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERRIGHT]);//near right
-						vertices[currentVertex++] = vertex_t(glm::vec3( 1.f, 1.f, 0.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERLEFT]);//near left
-					}
-					//left
-					if(get(x-1, y, z).type == BLOCK_AIR)// || get(x-1, y, z).visible == 0)
-					{
-						//get(x,y,z).visible |= 0b10010000;
-						steps++;
-						//vertices[currentVertex++] = vertex_t(glm::vec3(-.5f,-.5f,-1.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERLEFT]);//far lower
-						//vertices[currentVertex++] = vertex_t(glm::vec3(-.5f,-.5f, 0.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERRIGHT]);//near lower
-						//vertices[currentVertex++] = vertex_t(glm::vec3(-.5f, .5f, 0.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERRIGHT]);//near upper
-						//vertices[currentVertex++] = vertex_t(glm::vec3(-.5f, .5f,-1.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERLEFT]);//far upper
-						vertices[currentVertex++] = vertex_t(glm::vec3( 0.f, 0.f, 1.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERLEFT]);//far left
-						vertices[currentVertex++] = vertex_t(glm::vec3( 0.f, 0.f, 0.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERRIGHT]);//far right
-						vertices[currentVertex++] = vertex_t(glm::vec3( 0.f, 1.f, 0.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERRIGHT]);//near right
-						vertices[currentVertex++] = vertex_t(glm::vec3( 0.f, 1.f, 1.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERLEFT]);//near left
-					}
-					//bottom
-					if(get(x, y-1, z).type == BLOCK_AIR)// || get(x, y-1, z).visible == 0)
-					{
-						//get(x,y,z).visible |= 0b10001000;
-						steps++;
-						vertices[currentVertex++] = vertex_t(glm::vec3( 0.f, 0.f, 1.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERLEFT]);//far left
-						vertices[currentVertex++] = vertex_t(glm::vec3( 1.f, 0.f, 1.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERRIGHT]);//far right
-						vertices[currentVertex++] = vertex_t(glm::vec3( 1.f, 0.f, 0.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERRIGHT]);//near right
-						vertices[currentVertex++] = vertex_t(glm::vec3( 0.f, 0.f, 0.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERLEFT]);//near left
-					}
-					//back
-					if(get(x, y, z+1).type == BLOCK_AIR)// || get(x, y, z-1).visible == 0)
+		for(int s = 0; s < sliceCount; s++)
+		{
+			if(!sliceUsed[s])
+				continue;
+			unsigned char *mask = &masks[s * vCount * uCount];
+
+			for(int v = 0; v < vCount; v++)
+				for(int u = 0; u < uCount; )
+				{
+					unsigned char type = mask[v * uCount + u];
+					if(type == BLOCK_AIR)
 					{
-						//get(x,y,z).visible |= 0b10000100;
-						steps++;
-						//vertices[currentVertex++] = vertex_t(glm::vec3( .5f,-.5f,-1.0f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERLEFT]);//lower right
-						//vertices[currentVertex++] = vertex_t(glm::vec3(-.5f,-.5f,-1.0f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERRIGHT]);//lower left
-						//vertices[currentVertex++] = vertex_t(glm::vec3(-.5f, .5f,-1.0f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERRIGHT]);//upper left
-						//vertices[currentVertex++] = vertex_t(glm::vec3( .5f, .5f,-1.0f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERLEFT]);//upper right
-						vertices[currentVertex++] = vertex_t(glm::vec3( 1.f, 0.f, 1.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERLEFT]);//far left
-						vertices[currentVertex++] = vertex_t(glm::vec3( 0.f, 0.f, 1.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERRIGHT]);//far right
-						vertices[currentVertex++] = vertex_t(glm::vec3( 0.f, 1.f, 1.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERRIGHT]);//near right
-						vertices[currentVertex++] = vertex_t(glm::vec3( 1.f, 1.f, 1.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERLEFT]);//near left
+						u++;
+						continue;
 					}
-					//top
-					if(get(x, y+1, z).type == BLOCK_AIR)// || get(x, y+1, z).visible == 0)
+
+					//grow along u as long as the type matches, then along v as long as whole rows match
+					int w = 1, h = 1;
+					if(greedy)
 					{
-						if(mergeFaces)
-						{
-							if(!(get(x,y,z-1).visible & 0b00000010) && !(get(x,y,z-1).visible & 0b01000000)) //if top of previons block isnt visible(!!!) && block wasnt handled before
-							{
-								//get(x,y,z).visible |= 0b10000010;
-								//7				6	5			4		 3			2	   1   0
-								//visible		right	left bottom back top front
-								//TODO
-								steps++;
-
-								int zMerge = 0;
-								while((get(x,y,z + zMerge).visible & 0b00000010) || zMerge > zSize)//while end of plane not reached || zMerge > zSize
-								{
-									get(x,y,z + zMerge).visible |= 0b01000000;
-									zMerge++;
-								}
-								glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT); 
-								glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-								vertices[currentVertex++] = vertex_t(glm::vec3( .5f,.5f,-1.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERLEFT]);//near left
-								vertices[currentVertex++] = vertex_t(glm::vec3(-.5f,.5f,-1.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERRIGHT]);//near right
-
-								vertices[currentVertex++] = vertex_t(glm::vec3(-.5f, .5f, 0.f)+pos+glm::vec3(0,0,zMerge-1), blockTexCoord[(get(x,y,z).type *4-4) + LOWERRIGHT]);//far right
-								vertices[currentVertex++] = vertex_t(glm::vec3( .5f, .5f, 0.f)+pos+glm::vec3(0,0,zMerge-1), blockTexCoord[(get(x,y,z).type *4-4) + LOWERLEFT]);//far left
-							}
-						}
-						else
+						while(u + w < uCount && mask[v * uCount + u + w] == type)
+							w++;
+						bool rowMatches = true;
+						while(v + h < vCount && rowMatches)
 						{
-							//vertices[currentVertex++] = vertex_t(glm::vec3( 0.f, 1.f, 0.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERLEFT]);//near left
-							//vertices[currentVertex++] = vertex_t(glm::vec3( 1.f, 1.f, 0.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERRIGHT]);//near right
-							//vertices[currentVertex++] = vertex_t(glm::vec3( 1.f, 1.f, 1.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERRIGHT]);//far right
-							//vertices[currentVertex++] = vertex_t(glm::vec3( 0.f, 1.f, 1.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERLEFT]);//far left
-							//vertices[currentVertex++] = vertex_t(glm::vec3(-.5f, .5f, 0.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERLEFT]);
-							//vertices[currentVertex++] = vertex_t(glm::vec3( .5f, .5f, 0.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERRIGHT]);
-							//vertices[currentVertex++] = vertex_t(glm::vec3( .5f, .5f,-1.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERRIGHT]);
-							//vertices[currentVertex++] = vertex_t(glm::vec3(-.5f, .5f,-1.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERLEFT]);
-							vertices[currentVertex++] = vertex_t(glm::vec3( 0.f, 1.f, 0.f) + pos, blockTexCoord[(get(x,y,z).type * 4 - 4) + LOWERLEFT]);//far left
-							vertices[currentVertex++] = vertex_t(glm::vec3( 1.f, 1.f, 0.f) + pos, blockTexCoord[(get(x,y,z).type * 4 - 4) + LOWERRIGHT]);//far right
-							vertices[currentVertex++] = vertex_t(glm::vec3( 1.f, 1.f, 1.f) + pos, blockTexCoord[(get(x,y,z).type * 4 - 4) + UPPERRIGHT]);//near right
-							vertices[currentVertex++] = vertex_t(glm::vec3( 0.f, 1.f, 1.f) + pos, blockTexCoord[(get(x,y,z).type * 4 - 4) + UPPERLEFT]);//near left
+							for(int k = 0; k < w && rowMatches; k++)
+								rowMatches = mask[(v + h) * uCount + u + k] == type;
+							if(rowMatches)
+								h++;
 						}
+						for(int l = 0; l < h; l++)
+							for(int k = 0; k < w; k++)
+								mask[(v + l) * uCount + u + k] = BLOCK_AIR;
 					}
-					//front
-					if(get(x, y, z-1).type == BLOCK_AIR)// || get(x, y, z+1).visible == 0)
+
+					int p[3];
+					p[face.axis] = s;
+					p[face.u] = u;
+					p[face.v] = v;
+					glm::ivec3 pos = glm::ivec3(p[0], p[1], p[2]) * scale;
+					for(unsigned int c = 0; c < 4; c++)
 					{
-						//get(x,y,z).visible |= 0b10000001;
-						steps++;
-						//vertices[currentVertex++] = vertex_t(glm::vec3(-.5f,-.5f, 0.0f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERLEFT]);//lower left
-						//vertices[currentVertex++] = vertex_t(glm::vec3( .5f,-.5f, 0.0f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERRIGHT]);//lower right
-						//vertices[currentVertex++] = vertex_t(glm::vec3( .5f, .5f, 0.0f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERRIGHT]);//upper right
-						//vertices[currentVertex++] = vertex_t(glm::vec3(-.5f, .5f, 0.0f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERLEFT]);//upper left
-						vertices[currentVertex++] = vertex_t(glm::vec3( 0.f, 0.f, 0.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERLEFT]);//far left
-						vertices[currentVertex++] = vertex_t(glm::vec3( 1.f, 0.f, 0.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + LOWERRIGHT]);//far right
-						vertices[currentVertex++] = vertex_t(glm::vec3( 1.f, 1.f, 0.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERRIGHT]);//near right
-						vertices[currentVertex++] = vertex_t(glm::vec3( 0.f, 1.f, 0.f) + pos, blockTexCoord[(get(x,y,z).type *4-4) + UPPERLEFT]);//near left
+						//stretch the unit face corners over the merged rectangle
+						glm::ivec3 corner = glm::ivec3(face.corners[c][0], face.corners[c][1], face.corners[c][2]);
+						corner[face.axis] *= scale;
+						corner[face.u] *= w * scale;
+						corner[face.v] *= h * scale;
+#ifdef CHUNK_PACKED_VERTICES
+						vertices.push_back(packedVertex_t(pos + corner, f, glm::ivec2(tileCorner[c] * glm::vec2(w * scale, h * scale)), type - 1));
+#else
+						vertices.push_back(vertex_t(glm::vec3(pos + corner) + glm::vec3(xOff, yOff, zOff), tileCorner[c] * glm::vec2(w * scale, h * scale), blockTexCoord[type * 4 - 4 + UPPERLEFT]));
+#endif
 					}
+					u += w;
 				}
-			}
-	//cout << "vertices allocated: " << vertexCount << endl;
-	//cout << "vertices processed: " << currentVertex << endl;
+		}
+	}
 
-	return currentVertex;
+	if(staging)
+		staging->release(scratch);
+
+	vertexCount = vertices.size();
+	memoryAllocationMesh = vertices.capacity() * sizeof(chunkVertex_t);
+	return vertexCount;
 }
 
-void motor::Chunk::reCalculateVisibleSides(bool mergeFaces)
+void motor::Chunk::reCalculateVisibleSides(bool greedy)
 {
-	calculateVisibleSides(xOff, yOff, zOff, mergeFaces);
+	calculateVisibleSides(xOff, yOff, zOff, greedy);
 }
 
-void motor::Chunk::uploadToVbo()
+void motor::Chunk::uploadToVbo(VertexArena &arena, MeshStaging *staging)
 {
-	GLsizeiptr const vertexSize = vertexCount * sizeof(vertex_t);
+	if(vertices.size() != vertexCount)
+		return; //already uploaded since the last mesh
+
+	//reuse the old range if the mesh still fits and is not much smaller, else move
+	if(vertexCount > allocation.capacity || vertexCount < allocation.capacity / 4)
+	{
+		arena.release(allocation);
+		//some slack so a few placed blocks do not move the mesh every time
+		unsigned int capacity = vertexCount ? (vertexCount + vertexCount / 8 + 63) & ~63u : 0;
+		allocation = arena.allocate(capacity);
+	}
+	arena.upload(allocation, vertexCount ? &vertices[0] : NULL, vertexCount);
 
-	glDeleteBuffers(1, &vertexBuffer);
-	glGenBuffers(1, &vertexBuffer);
-	//cout << vertexBuffer << endl;
-	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-	//cout << "vertex size: " << vertexSize << " vertices:" << vertices << endl;
-	glBufferData(GL_ARRAY_BUFFER, vertexSize, vertices, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	//the gpu has its copy, the array goes back to the pool or is freed
+	if(staging)
+		staging->recycle(vertices);
+	else
+		vector<chunkVertex_t>().swap(vertices);
+	memoryAllocationMesh = 0;
+	memoryAllocationGfx = allocation.capacity * sizeof(chunkVertex_t);
+	uploadedVertexCount = vertexCount;
+	connectivity = meshConnectivity;
 }
 
 unsigned int motor::Chunk::getVertexCount()
 {
 	return vertexCount;
 }
+
+unsigned int motor::Chunk::getUploadedVertexCount()
+{
+	return uploadedVertexCount;
+}
+
+void motor::Chunk::setLod(unsigned int level)
+{
+	//every level halves the chunk, so it has to divide evenly
+	level = min(level, CHUNK_MAX_LOD);
+	while(level > 0 && (xSize % (1 << level) || ySize % (1 << level) || zSize % (1 << level)))
+		level--;
+	lod = level;
+}
+
+unsigned int motor::Chunk::getLod()
+{
+	return lod;
+}
+
+bool motor::Chunk::connects(unsigned int a, unsigned int b)
+{
+	return (connectivity >> (a * 6 + b)) & 1;
+}
+
+void motor::Chunk::calculateConnectivity(const uint64_t *yColumns, meshScratch_t *scratch)
+{
+	//flood fill the air from the border, each filled region connects all the faces it touches;
+	//works on whole runs of air in the y columns of the mesher (padded, bit y + 1 is block y)
+	int xPad = xSize + 2;
+	uint64_t interior = ((uint64_t(1) << ySize) - 1) << 1;
+	uint64_t bottom = 2, top = uint64_t(1) << ySize;
+	vector<uint64_t> &visited = scratch->visited;
+	vector<pair<int, uint64_t> > &fill = scratch->fill;
+	visited.assign(xSize * zSize, 0);
+	meshConnectivity = 0;
+
+#define _AIR(x, z) (~yColumns[((z) + 1) * xPad + (x) + 1] & interior)
+	for(int x = 0; x < xSize; x++)
+		for(int z = 0; z < zSize; z++)
+		{
+			//regions that do not reach the border connect nothing
+			bool border = x == 0 || x == xSize - 1 || z == 0 || z == zSize - 1;
+			uint64_t seeds = _AIR(x, z) & ~visited[x * zSize + z];
+			if(!border)
+				seeds &= bottom | top;
+
+			while(seeds)
+			{
+				unsigned int faces = 0;
+				fill.assign(1, make_pair(x * zSize + z, seeds & (~seeds + 1)));
+				while(!fill.empty())
+				{
+					int c = fill.back().first;
+					uint64_t run = fill.back().second;
+					fill.pop_back();
+					int cx = c / zSize, cz = c % zSize;
+					uint64_t air = _AIR(cx, cz);
+					run &= air & ~visited[c];
+					if(run == 0)
+						continue;
+
+					//grow the seed bits to the whole runs of air they are in
+					uint64_t previous;
+					do
+					{
+						previous = run;
+						run = (run | run << 1 | run >> 1) & air;
+					} while(run != previous);
+					visited[c] |= run;
+
+					if(run & bottom) faces |= 1 << 2;
+					if(run & top) faces |= 1 << 4;
+					if(cx == xSize - 1) faces |= 1 << 0; else fill.push_back(make_pair(c + zSize, run));
+					if(cx == 0) faces |= 1 << 1; else fill.push_back(make_pair(c - zSize, run));
+					if(cz == zSize - 1) faces |= 1 << 3; else fill.push_back(make_pair(c + 1, run));
+					if(cz == 0) faces |= 1 << 5; else fill.push_back(make_pair(c - 1, run));
+				}
+
+				for(unsigned int a = 0; a < 6; a++)
+					if(faces & (1 << a))
+						meshConnectivity |= uint64_t(faces) << (a * 6);
+				seeds &= ~visited[x * zSize + z];
+			}
+		}
+#undef _AIR
+}
+
+unsigned int motor::meshScratch_t::getBytes() const
+{
+	unsigned int bytes = padded.capacity() + masks.capacity() + visible.capacity() * sizeof(uint64_t) + sliceUsed.capacity() / 8;
+	bytes += lodPadded.capacity() + visited.capacity() * sizeof(uint64_t) + fill.capacity() * sizeof(pair<int, uint64_t>);
+	for(unsigned int a = 0; a < 3; a++)
+		bytes += columns[a].capacity() * sizeof(uint64_t);
+	return bytes;
+}
+
+motor::MeshStaging::MeshStaging(unsigned int keepVertexArrays)
+{
+	this->keepVertexArrays = keepVertexArrays;
+	mutex = SDL_CreateMutex();
+}
+
+motor::MeshStaging::~MeshStaging()
+{
+	for(unsigned int i = 0; i < freeScratch.size(); i++)
+		delete freeScratch[i];
+	SDL_DestroyMutex(mutex);
+}
+
+motor::meshScratch_t* motor::MeshStaging::acquire()
+{
+	meshScratch_t *scratch = NULL;
+	SDL_LockMutex(mutex);
+	if(!freeScratch.empty())
+	{
+		scratch = freeScratch.back();
+		freeScratch.pop_back();
+	}
+	SDL_UnlockMutex(mutex);
+	return scratch ? scratch : new meshScratch_t;
+}
+
+void motor::MeshStaging::release(meshScratch_t *scratch)
+{
+	SDL_LockMutex(mutex);
+	freeScratch.push_back(scratch);
+	SDL_UnlockMutex(mutex);
+}
+
+void motor::MeshStaging::take(vector<chunkVertex_t> &vertices)
+{
+	SDL_LockMutex(mutex);
+	if(!freeVertices.empty())
+	{
+		vertices.swap(freeVertices.front());
+		freeVertices.pop_front();
+	}
+	SDL_UnlockMutex(mutex);
+}
+
+void motor::MeshStaging::recycle(vector<chunkVertex_t> &vertices)
+{
+	vertices.clear();
+	SDL_LockMutex(mutex);
+	if(freeVertices.size() < keepVertexArrays && vertices.capacity() > 0)
+	{
+		freeVertices.push_back(vector<chunkVertex_t>());
+		freeVertices.back().swap(vertices);
+	}
+	SDL_UnlockMutex(mutex);
+	vector<chunkVertex_t>().swap(vertices);
+}
+
+unsigned int motor::MeshStaging::getBytes()
+{
+	unsigned int bytes = 0;
+	SDL_LockMutex(mutex);
+	for(unsigned int i = 0; i < freeScratch.size(); i++)
+		bytes += sizeof(meshScratch_t) + freeScratch[i]->getBytes();
+	for(list<vector<chunkVertex_t> >::iterator it = freeVertices.begin(); it != freeVertices.end(); it++)
+		bytes += it->capacity() * sizeof(chunkVertex_t);
+	SDL_UnlockMutex(mutex);
+	return bytes;
+}
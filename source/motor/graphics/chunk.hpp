@@ -3,9 +3,14 @@
 
 #include <cstdlib>
 #include <iostream>
+#include <list>
 #include <vector>
+#include <stdint.h>
 using namespace std;
 
+#include <SDL/SDL.h>
+#include <SDL/SDL_thread.h>
+
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include <motor/math/glm/glm.hpp>
@@ -14,17 +19,39 @@ using namespace std;
 #include <motor/math/glm/gtc/type_ptr.hpp>
 
 #include "motor/utility/blocks.hpp"
+#include "vertexArena.hpp"
 
 namespace motor
 {
 	typedef struct vertex_t
 	{
-		vertex_t(glm::vec3 const & Position, glm::vec2 const & Texcoord):	Position(Position),	Texcoord(Texcoord) {}
+		vertex_t(glm::vec3 const & Position, glm::vec2 const & Texcoord, glm::vec2 const & Tile):	Position(Position),	Texcoord(Texcoord), Tile(Tile) {}
 		vertex_t() {}
 		glm::vec3 Position;
-		glm::vec2 Texcoord;
+		glm::vec2 Texcoord; //in tile space, one unit per block so merged faces repeat the texture
+		glm::vec2 Tile; //upper left corner of the blocks tile in the tileset
 	} vertex_t;
 
+	//8 byte vertex for chunk meshes, positions are relative to the chunk origin (a uniform)
+	//and the tile is an index into the tileset, data/base.vert rebuilds the rest
+	typedef struct packedVertex_t
+	{
+		packedVertex_t(glm::ivec3 const & Position, unsigned char Face, glm::ivec2 const & Texcoord, unsigned char Tile):
+			x(Position.x), y(Position.y), z(Position.z), face(Face), u(Texcoord.x), v(Texcoord.y), tile(Tile), unused(0) {}
+		packedVertex_t() {}
+		unsigned char x, y, z, face; //face is the index into the face table of the mesher
+		unsigned char u, v, tile, unused; //u, v in tile space like vertex_t::Texcoord
+	} packedVertex_t;
+
+	//vertex format of the chunk meshes, chosen at compile time (see SConscript)
+#ifdef CHUNK_PACKED_VERTICES
+	typedef packedVertex_t chunkVertex_t;
+	const bool CHUNK_PACKED = true;
+#else
+	typedef vertex_t chunkVertex_t;
+	const bool CHUNK_PACKED = false;
+#endif
+
 	typedef struct block_t
 	{
 		unsigned char type;
@@ -35,10 +62,70 @@ namespace motor
 		block_t(unsigned char tp, unsigned char vs)
 		{
 			type = tp;
-			visible = visible;
+			visible = vs;
 		}
 	} block_t;
 
+	//memory layout of the voxels inside a chunk, chosen at compile time (see SConscript)
+	//linear xzy: y runs fastest, so a column of blocks is contiguous
+	//morton: bits of x, y and z are interleaved (z-order curve), needs power of two dimensions
+#ifdef CHUNK_LAYOUT_MORTON
+	const char CHUNK_LAYOUT_NAME[] = "morton";
+#else
+	const char CHUNK_LAYOUT_NAME[] = "linear xzy";
+#endif
+
+	//the blocks of a chunk are stored as indices into a small palette of block types,
+	//packed with 1, 2, 4 or 8 bits per voxel; the width grows when set() adds a new type.
+	//a chunk of a single type (all air, all stone) is uniform: 0 bits and no voxel storage
+	const unsigned int CHUNK_MAX_PALETTE = 256;
+
+	//the mesher keeps a column of the chunk plus its two border blocks in one 64 bit word
+	const unsigned int CHUNK_MAX_SIZE = 62;
+
+	//distant chunks get meshed at 2x, 4x or 8x the block size, see Chunk::setLod
+	const unsigned int CHUNK_MAX_LOD = 3;
+
+	//the six faces of a chunk in the order of the mesher, as a unit step along their normal
+	const int CHUNK_FACE_NORMALS[6][3] = {{1, 0, 0}, {-1, 0, 0}, {0, -1, 0}, {0, 0, 1}, {0, 1, 0}, {0, 0, -1}};
+	const unsigned int CHUNK_FACE_OPPOSITE[6] = {1, 0, 4, 5, 2, 3};
+
+	//working memory of one calculateVisibleSides call
+	typedef struct meshScratch_t
+	{
+		vector<unsigned char> padded;
+		vector<unsigned char> lodPadded;
+		vector<uint64_t> columns[3];
+		vector<uint64_t> visible;
+		vector<unsigned char> masks;
+		vector<bool> sliceUsed;
+		vector<uint64_t> visited; //flood fill of the air for the connectivity, one word per y column
+		vector<pair<int, uint64_t> > fill;
+		unsigned int getBytes() const;
+	} meshScratch_t;
+
+	//thread safe pool of mesher scratch, one per thread that is meshing at the same time,
+	//and of vertex arrays handed back after their upload, so meshing stops allocating once warm
+	class MeshStaging
+	{
+		public:
+			MeshStaging(unsigned int keepVertexArrays = 16);
+			~MeshStaging();
+
+			meshScratch_t* acquire();
+			void release(meshScratch_t *scratch);
+			void take(vector<chunkVertex_t> &vertices); //swaps in a recycled array, if there is one
+			void recycle(vector<chunkVertex_t> &vertices); //leaves vertices empty, without capacity
+
+			unsigned int getBytes(); //held by the pool, not counting scratch in use
+
+		private:
+			vector<meshScratch_t*> freeScratch;
+			list<vector<chunkVertex_t> > freeVertices;
+			unsigned int keepVertexArrays;
+			SDL_mutex *mutex;
+	};
+
 	class World; //hack for circular dependency
 	class Chunk
 	{
@@ -47,31 +134,115 @@ namespace motor
 			Chunk(unsigned int xDim, unsigned int yDim, unsigned int zDim);
 			~Chunk();
 
+			void init(unsigned int xDim, unsigned int yDim, unsigned int zDim);
 			void setWorldRef(World *wrld);
 
 			void set(glm::ivec3 &coord, unsigned short blockType);
 			void set(unsigned int x, unsigned int y, unsigned int z, unsigned short blockType);
-			block_t& get(glm::ivec3 &coord);
+			block_t get(glm::ivec3 &coord);
 			//block_t get(unsigned int x, unsigned int y, unsigned int z);
-			block_t& get(int x, int y, int z);
+			block_t get(int x, int y, int z);
 
-			unsigned int calculateVisibleSides(unsigned int, unsigned int, unsigned int, bool mergeFaces = false);
-			void reCalculateVisibleSides(bool mergeFaces = false);
-			void uploadToVbo();
+			//whole chunk access, types are in linear xzy order: types[(x * zSize + z) * ySize + y]
+			void getAll(unsigned char *types) const;
+			void setAll(const unsigned char *types);
+
+			unsigned int getBitsPerBlock();
+			unsigned int getPaletteSize();
+			const unsigned char* getPalette();
+			const unsigned char* getVoxels(); //the packed indices in the layout of this build, NULL when uniform
+			unsigned int getVoxelBytes();
+			unsigned int getVoxelCount(); //packed indices, the morton layout pads the chunk to a cube
+			//uses packed indices the chunk does not own, e.g. in a mapped snapshot, as its voxels;
+			//edits write to them in place, a palette that outgrows bits moves them to an own copy
+			void mapVoxels(unsigned char *packed, unsigned int bits, const unsigned char *types, unsigned int paletteSize);
+			bool isUniform();
+			void compact(); //drops unused palette entries, goes back to uniform if only one type is left
+
+			//greedy merges coplanar faces of the same type into rectangles
+			//staging, if given, provides the scratch memory and takes the vertices back after the upload
+			unsigned int calculateVisibleSides(int xOff, int yOff, int zOff, bool greedy = false, MeshStaging *staging = NULL);
+			void reCalculateVisibleSides(bool greedy = false);
+			void uploadToVbo(VertexArena &arena, MeshStaging *staging = NULL);
 			unsigned int getVertexCount();
+			unsigned int getUploadedVertexCount(); //of the mesh in the arena, the one that is drawn
+			//whether air connects faces a and b through this chunk (CHUNK_FACE_NORMALS order), from the uploaded mesh
+			bool connects(unsigned int a, unsigned int b);
+			//level of detail of the next mesh, blocks are 1 << level large; needs a remesh
+			void setLod(unsigned int level);
+			unsigned int getLod();
 
-			unsigned int vertexBuffer;
+			arenaAllocation_t allocation; //where the mesh lives in the world's vertex arena
+			bool dirty; //blocks changed since the last mesh, see World::flushDirty
 
-			unsigned int memoryAllocationGfx;
-			unsigned int memoryAllocationRam;
+			unsigned int memoryAllocationGfx; //bytes of the arena range of the mesh
+			unsigned int memoryAllocationRam; //bytes of the blocks and palette
+			unsigned int memoryAllocationMesh; //bytes of the vertices waiting for their upload
 
 		private:
-			block_t ***voxels;
+			unsigned int index(int x, int y, int z) const;
+			unsigned char getIndex(unsigned int i) const;
+			void setIndex(unsigned int i, unsigned char paletteIndex);
+			bool repack(unsigned int bits);//false if the voxels could not be allocated, then nothing changed
+			void releaseVoxels(); //frees them unless they are mapped
+			void updateMemoryAllocation();
+			void fillPadded(unsigned char *padded);
+			void fillPaddedLod(const unsigned char *padded, unsigned char *lodPadded);
+			bool isEnclosed(); //uniform solid and all neighbors too, so there is nothing to mesh
+			void calculateConnectivity(const uint64_t *yColumns, meshScratch_t *scratch);
+
+			unsigned char *voxels; //packed palette indices, one aligned allocation addressed through index()
+			bool voxelsMapped; //see mapVoxels
+			unsigned int voxelCount;
+			unsigned int bitsPerBlock, bitsShift; //bitsPerBlock == 1 << bitsShift, or both 0 when uniform
+			vector<unsigned char> palette;
 			int xSize, ySize, zSize;
 			int xOff, yOff, zOff;
-			vertex_t *vertices;
-			unsigned int vertexCount;
+			vector<chunkVertex_t> vertices;
+			unsigned int vertexCount, uploadedVertexCount;
+			//bit a * 6 + b is set if air connects face a and face b; the mesher writes meshConnectivity on
+			//a worker, the upload hands it to connectivity, which is what the thread that draws reads
+			uint64_t connectivity, meshConnectivity;
+			unsigned int lod;
 			World *world;
 	};
+
+	//spreads the lower 10 bits of v so that there are two zero bits between each of them
+	inline unsigned int mortonSpread(unsigned int v)
+	{
+		v &= 0x000003FF;
+		v = (v | (v << 16)) & 0xFF0000FF;
+		v = (v | (v <<  8)) & 0x0300F00F;
+		v = (v | (v <<  4)) & 0x030C30C3;
+		v = (v | (v <<  2)) & 0x09249249;
+		return v;
+	}
+
+	inline unsigned int Chunk::index(int x, int y, int z) const
+	{
+#ifdef CHUNK_LAYOUT_MORTON
+		return mortonSpread(x) | (mortonSpread(y) << 1) | (mortonSpread(z) << 2);
+#else
+		return (x * zSize + z) * ySize + y;
+#endif
+	}
+
+	inline unsigned char Chunk::getIndex(unsigned int i) const
+	{
+		if(bitsPerBlock == 0)
+			return 0;
+		unsigned int perByteShift = 3 - bitsShift; //log2 of the indices per byte
+		unsigned int shift = (i & ((1 << perByteShift) - 1)) << bitsShift;
+		return (voxels[i >> perByteShift] >> shift) & ((1 << bitsPerBlock) - 1);
+	}
+
+	inline void Chunk::setIndex(unsigned int i, unsigned char paletteIndex)
+	{
+		unsigned int perByteShift = 3 - bitsShift;
+		unsigned int shift = (i & ((1 << perByteShift) - 1)) << bitsShift;
+		unsigned char mask = ((1 << bitsPerBlock) - 1) << shift;
+		unsigned char &byte = voxels[i >> perByteShift];
+		byte = (byte & ~mask) | ((paletteIndex << shift) & mask);
+	}
 }
 #endif
@@ -0,0 +1,147 @@
+#include "vertexArena.hpp"
+
+motor::VertexArena::VertexArena(unsigned int vertexSize, unsigned int pageVertices)
+{
+	this->vertexSize = vertexSize;
+	this->pageVertices = pageVertices;
+}
+
+motor::VertexArena::~VertexArena()
+{
+	for(unsigned int i = 0; i < pages.size(); i++)
+		glDeleteBuffers(1, &pages[i].buffer);
+}
+
+void motor::VertexArena::addPage(unsigned int vertices)
+{
+	page_t page;
+	page.capacity = vertices;
+	range_t all = {0, vertices};
+	page.freeRanges.push_back(all);
+
+	glGenBuffers(1, &page.buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, page.buffer);
+	glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(vertices) * vertexSize, NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	pages.push_back(page);
+}
+
+bool motor::VertexArena::allocateFrom(page_t &page, unsigned int vertices, unsigned int &first)
+{
+	for(list<range_t>::iterator it = page.freeRanges.begin(); it != page.freeRanges.end(); it++)
+		if(it->count >= vertices)
+		{
+			first = it->first;
+			it->first += vertices;
+			it->count -= vertices;
+			if(it->count == 0)
+				page.freeRanges.erase(it);
+			return true;
+		}
+	return false;
+}
+
+motor::arenaAllocation_t motor::VertexArena::allocate(unsigned int vertices)
+{
+	arenaAllocation_t allocation;
+	if(vertices == 0)
+		return allocation;
+
+	for(unsigned int i = 0; i < pages.size(); i++)
+		if(allocateFrom(pages[i], vertices, allocation.first))
+		{
+			allocation.page = i;
+			allocation.capacity = vertices;
+			return allocation;
+		}
+
+	//meshes bigger than a page get a page of their own
+	addPage(max(vertices, pageVertices));
+	allocation.page = pages.size() - 1;
+	allocateFrom(pages.back(), vertices, allocation.first);
+	allocation.capacity = vertices;
+	return allocation;
+}
+
+void motor::VertexArena::release(arenaAllocation_t &allocation)
+{
+	if(allocation.capacity == 0)
+		return;
+
+	page_t &page = pages[allocation.page];
+	range_t range = {allocation.first, allocation.capacity};
+	allocation = arenaAllocation_t();
+
+	//insert sorted and merge with the neighbors it touches
+	list<range_t>::iterator next = page.freeRanges.begin();
+	while(next != page.freeRanges.end() && next->first < range.first)
+		next++;
+	list<range_t>::iterator it = page.freeRanges.insert(next, range);
+
+	if(next != page.freeRanges.end() && it->first + it->count == next->first)
+	{
+		it->count += next->count;
+		page.freeRanges.erase(next);
+	}
+	if(it != page.freeRanges.begin())
+	{
+		list<range_t>::iterator previous = it;
+		previous--;
+		if(previous->first + previous->count == it->first)
+		{
+			previous->count += it->count;
+			page.freeRanges.erase(it);
+		}
+	}
+}
+
+void motor::VertexArena::upload(const arenaAllocation_t &allocation, const void *data, unsigned int vertices)
+{
+	if(vertices == 0 || vertices > allocation.capacity)
+		return;
+	glBindBuffer(GL_ARRAY_BUFFER, pages[allocation.page].buffer);
+	glBufferSubData(GL_ARRAY_BUFFER, GLintptr(allocation.first) * vertexSize, GLsizeiptr(vertices) * vertexSize, data);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+unsigned int motor::VertexArena::getBuffer(unsigned int page)
+{
+	return pages[page].buffer;
+}
+
+unsigned int motor::VertexArena::getPageCount()
+{
+	return pages.size();
+}
+
+motor::arenaStats_t motor::VertexArena::getStats()
+{
+	arenaStats_t stats = {0, 0, 0, 0, 0, 0};
+	stats.pages = pages.size();
+	for(unsigned int i = 0; i < pages.size(); i++)
+	{
+		unsigned int freeVertices = 0, largest = 0;
+		for(list<range_t>::iterator it = pages[i].freeRanges.begin(); it != pages[i].freeRanges.end(); it++)
+		{
+			freeVertices += it->count;
+			largest = max(largest, it->count);
+			stats.freeBlocks++;
+		}
+		stats.largestFree = max(stats.largestFree, largest * vertexSize);
+		stats.contiguousFree += largest * vertexSize;
+		stats.capacity += pages[i].capacity * vertexSize;
+		stats.allocated += (pages[i].capacity - freeVertices) * vertexSize;
+	}
+	return stats;
+}
+
+void motor::VertexArena::printStats()
+{
+	arenaStats_t stats = getStats();
+	unsigned int freeBytes = stats.capacity - stats.allocated;
+	//how much of the free space is split off from the biggest block of its buffer
+	float fragmentation = freeBytes ? 1.f - float(stats.contiguousFree) / float(freeBytes) : 0.f;
+	cout << "vertex arena: " << stats.pages << " buffers, " << float(stats.allocated) / 1000.f << " of " << float(stats.capacity) / 1000.f << " kB allocated, ";
+	cout << stats.freeBlocks << " free blocks, largest " << float(stats.largestFree) / 1000.f << " kB, fragmentation " << fragmentation * 100.f << "%" << endl;
+}
@@ -0,0 +1,71 @@
+#ifndef _VERTEXARENA_HPP
+#define _VERTEXARENA_HPP
+
+#include <iostream>
+#include <list>
+#include <vector>
+using namespace std;
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+namespace motor
+{
+	//a range of vertices inside one of the buffers of a VertexArena
+	typedef struct arenaAllocation_t
+	{
+		arenaAllocation_t() : page(0), first(0), capacity(0) {}
+		unsigned int page; //index of the buffer
+		unsigned int first; //in vertices, what glDrawArrays wants as first
+		unsigned int capacity; //in vertices, 0 if nothing is allocated
+	} arenaAllocation_t;
+
+	typedef struct arenaStats_t
+	{
+		unsigned int pages;
+		unsigned int capacity; //all in bytes
+		unsigned int allocated;
+		unsigned int freeBlocks;
+		unsigned int largestFree;
+		unsigned int contiguousFree; //sum of the largest free block of each buffer
+	} arenaStats_t;
+
+	//a few large vertex buffers shared by all chunks, sub-allocated with a first fit free list
+	//instead of creating a buffer per mesh, needs a gl context from the first allocate() on
+	class VertexArena
+	{
+		public:
+			VertexArena(unsigned int vertexSize, unsigned int pageVertices = 1 << 19);
+			~VertexArena();
+
+			arenaAllocation_t allocate(unsigned int vertices);
+			void release(arenaAllocation_t &allocation);
+			void upload(const arenaAllocation_t &allocation, const void *data, unsigned int vertices); //in place, glBufferSubData
+
+			unsigned int getBuffer(unsigned int page);
+			unsigned int getPageCount();
+			arenaStats_t getStats();
+			void printStats();
+
+		private:
+			typedef struct range_t
+			{
+				unsigned int first, count;
+			} range_t;
+
+			typedef struct page_t
+			{
+				unsigned int buffer;
+				unsigned int capacity;
+				list<range_t> freeRanges; //sorted by first, never adjacent
+			} page_t;
+
+			bool allocateFrom(page_t &page, unsigned int vertices, unsigned int &first);
+			void addPage(unsigned int vertices);
+
+			vector<page_t> pages;
+			unsigned int vertexSize; //in bytes
+			unsigned int pageVertices;
+	};
+}
+#endif
@@ -1,187 +1,1937 @@
 #include "world.hpp"
+#include "motor/graphics/camera.hpp"
+#include "motor/math/aabb.hpp"
+#include "motor/math/integer.hpp"
 
-motor::World::World()
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+motor::World::World() : arena(sizeof(chunkVertex_t))
 {
 	//perlin.SetOctaveCount(1);
 	//perlin.SetFrequency(1.0);
 	//perlin.SetPersistence(1.0);
-	chunks = NULL;
+	greedyMeshing = false;
+	workers = NULL;
+	headless = false;
+	meshing = false;
+	uploadMutex = SDL_CreateMutex();
+	drawInitialized = false;
+	quadIndexBuffer = quadIndexCapacity = indirectBuffer = originBuffer = 0;
+	drawStats.chunks = drawStats.culled = drawStats.occluded = drawStats.drawCalls = drawStats.stateChanges = 0;
+	camera = NULL;
+	caveCulling = false;
+	lodDistance = 0;
+	caves = false;
+	streamRadius = 0;
+	streamHysteresis = 2;
+	streamComplete = false;
+	seed = 0;
+	keepSeed = false;
+	snapshot = NULL;
+	snapshotSize = 0;
+}
+
+motor::World::~World()
+{
+	//the meshes still running are not uploaded any more
+	if(meshing)
+		workers->wait();
+	for(unsigned int n = 0; n < loadedChunks.size(); n++)
+		delete loadedChunks[n].chunk;
+	for(regionMap_t::iterator it = regions.begin(); it != regions.end(); it++)
+		delete it->second.file;
+	if(snapshot)
+		munmap(snapshot, snapshotSize);
+	if(drawInitialized)
+	{
+		for(unsigned int i = 0; i < vertexArrays.size(); i++)
+			if(vertexArrays[i])
+				glDeleteVertexArrays(1, &vertexArrays[i]);
+		glDeleteBuffers(1, &quadIndexBuffer);
+		glDeleteBuffers(1, &indirectBuffer);
+		glDeleteBuffers(1, &originBuffer);
+	}
+	delete workers;
+	SDL_DestroyMutex(uploadMutex);
 }
 
-void motor::World::load(unsigned int sizeX,unsigned int sizeY, unsigned int sizeZ, unsigned int chunkSizeX, unsigned int chunkSizeY, unsigned int chunkSizeZ)
+void motor::World::load(unsigned int radius, unsigned int sizeY, unsigned int chunkSizeX, unsigned int chunkSizeY, unsigned int chunkSizeZ)
 {
-	worldDimX = sizeX;
+	streamRadius = radius;
 	worldDimY = sizeY;
-	worldDimZ = sizeZ;
 	this->chunkSizeX = chunkSizeX;
 	this->chunkSizeY = chunkSizeY;
 	this->chunkSizeZ = chunkSizeZ;
+	streamCenter = glm::ivec3(0, 0, 0);
+	streamComplete = false;
+
+	if(workers == NULL)
+	{
+		workers = new ThreadPool();
+		cout << "meshing and generating on " << workers->getThreadCount() << " threads" << endl;
+	}
+}
+
+//caves: the 3d noise is sampled every CAVE_STEP blocks, moves the surface up to CAVE_OVERHANG
+//blocks and carves caverns where it is above CAVE_THRESHOLD
+static const unsigned int CAVE_STEP = 4;
+static const float CAVE_OVERHANG = 6.f;
+static const float CAVE_THRESHOLD = 0.2f;
+
+//features: every chunk gets up to FEATURE_MOUNDS mounds of sand on its surface and FEATURE_VEINS
+//veins of dirt through its stone, walks of up to FEATURE_VEIN_LENGTH steps; both reach into the neighbors
+static const unsigned int FEATURE_MOUNDS = 2;
+static const unsigned int FEATURE_VEINS = 3;
+static const unsigned int FEATURE_VEIN_LENGTH = 8;
+
+motor::block_t motor::World::getBlock(int x, int y, int z)
+{
+	int cx = floorDiv(x, chunkSizeX), cy = floorDiv(y, chunkSizeY), cz = floorDiv(z, chunkSizeZ);
+	int n = findChunk(cx, cy, cz);
+	if(n < 0)
+		return block_t(BLOCK_OOB, 0xFF);
+	return loadedChunks[n].chunk->get(x - cx * int(chunkSizeX), y - cy * int(chunkSizeY), z - cz * int(chunkSizeZ));
+}
+
+motor::block_t motor::World::getBlock(glm::vec3 v)
+{
+	return getBlock(int(floor(v.x)), int(floor(v.y)), int(floor(v.z)));
+}
+
+void motor::World::setBlock(int x, int y, int z, unsigned int type)
+{
+	int cx = floorDiv(x, chunkSizeX), cy = floorDiv(y, chunkSizeY), cz = floorDiv(z, chunkSizeZ);
+	int n = findChunk(cx, cy, cz);
+	if(n < 0)
+		return;
+	Chunk *chunk = loadedChunks[n].chunk;
+
+	unsigned int lx = x - cx * int(chunkSizeX), ly = y - cy * int(chunkSizeY), lz = z - cz * int(chunkSizeZ);
+	if(chunk->get(lx, ly, lz).type == type)
+		return;
+	finishMeshing();
+	chunk->set(lx, ly, lz, type);
+	loadedChunks[n].unsaved = true;
+
+	//blocks on the border also decide which faces of the neighbor are visible
+	markDirty(cx, cy, cz);
+	if(lx == 0) markDirty(cx - 1, cy, cz);
+	if(ly == 0) markDirty(cx, cy - 1, cz);
+	if(lz == 0) markDirty(cx, cy, cz - 1);
+	if(lx == chunkSizeX - 1) markDirty(cx + 1, cy, cz);
+	if(ly == chunkSizeY - 1) markDirty(cx, cy + 1, cz);
+	if(lz == chunkSizeZ - 1) markDirty(cx, cy, cz + 1);
+}
+
+void motor::World::markDirty(int x, int y, int z)
+{
+	Chunk *chunk = getChunk(x, y, z);
+	if(chunk == NULL || chunk->dirty || headless)
+		return;
+	chunk->dirty = true;
+	dirtyChunks.push_back(glm::ivec3(x, y, z));
+}
+
+uint64_t motor::World::chunkKey(int x, int y, int z)
+{
+	//21 bits per axis, a million chunks in every direction
+	return (uint64_t(uint32_t(x) & 0x1FFFFF) << 42) | (uint64_t(uint32_t(y) & 0x1FFFFF) << 21) | uint64_t(uint32_t(z) & 0x1FFFFF);
+}
+
+int motor::World::findChunk(int x, int y, int z)
+{
+	chunkMap_t::const_iterator it = chunkMap.find(chunkKey(x, y, z));
+	return it == chunkMap.end() ? -1 : int(it->second);
+}
+
+motor::Chunk* motor::World::getChunk(int x, int y, int z)
+{
+	int n = findChunk(x, y, z);
+	return n < 0 ? NULL : loadedChunks[n].chunk;
+}
+
+unsigned int motor::World::getLoadedChunkCount()
+{
+	return loadedChunks.size();
+}
+
+unsigned int motor::World::getPendingEditCount()
+{
+	unsigned int count = 0;
+	for(pendingEditMap_t::const_iterator it = pendingEdits.begin(); it != pendingEdits.end(); it++)
+		for(unsigned int s = 0; s < it->second.sources.size(); s++)
+			count += it->second.sources[s].edits.size();
+	return count;
+}
+
+void motor::World::setGreedyMeshing(bool greedy)
+{
+	finishMeshing();
+	greedyMeshing = greedy;
+}
+
+void motor::World::setCaveCulling(bool caves)
+{
+	caveCulling = caves;
+}
+
+void motor::World::setCaves(bool caves)
+{
+	this->caves = caves;
+}
+
+void motor::World::setHeadless(bool headless)
+{
+	this->headless = headless;
+}
+
+void motor::World::setLodDistance(float distance)
+{
+	lodDistance = distance;
+}
+
+void motor::World::setHysteresis(unsigned int chunks)
+{
+	streamHysteresis = chunks;
+}
+
+void motor::World::loadChunks(unsigned int count)
+{
+	//region files share their scratch, so reading stays on this thread; the rest starts out empty
+	//and goes through the generation stages on the workers, see advanceStages
+	for(unsigned int n = 0; n < count; n++)
+	{
+		const glm::ivec3 &position = streamCandidates[n];
+		loadedChunk_t loaded = {new Chunk(chunkSizeX, chunkSizeY, chunkSizeZ), position.x, position.y, position.z, false, CHUNK_STAGE_EMPTY, NULL};
+		loaded.chunk->setWorldRef(this);
+		if(readChunk(loaded.chunk, position.x, position.y, position.z))
+			loaded.stage = CHUNK_STAGE_FEATURES;
+		else
+			loaded.unsaved = true;
+		addChunk(loaded);
+	}
+	advanceStages();
+}
+
+//whether the stage needs the neighbors at the stage before, next to whether the chunk itself is
+static const bool stageNeedsNeighbors[] = {false, false, false, true, true};
+
+bool motor::World::stageReady(unsigned int n, unsigned int stage)
+{
+	const loadedChunk_t &loaded = loadedChunks[n];
+	if(loaded.stage + 1u < stage)
+		return false;
+	if(!stageNeedsNeighbors[stage])
+		return true;
+
+	//neighbors that are streamed in have to be there, the ones outside of the radius do not
+	int radius = streamRadius;
+	for(int dx = -1; dx <= 1; dx++)
+		for(int dy = -1; dy <= 1; dy++)
+			for(int dz = -1; dz <= 1; dz++)
+			{
+				int x = loaded.x + dx, y = loaded.y + dy, z = loaded.z + dz;
+				int m = findChunk(x, y, z);
+				if(m >= 0 ? loadedChunks[m].stage + 1u < stage :
+						y >= 0 && y < int(worldDimY) && (x - streamCenter.x) * (x - streamCenter.x) + (z - streamCenter.z) * (z - streamCenter.z) <= radius * radius)
+					return false;
+			}
+	return true;
+}
 
-	chunks = new Chunk**[sizeX];
-	for(unsigned int i = 0; i < sizeX; i++)
+void motor::World::advanceStages()
+{
+	//in waves: every chunk whose next stage is ready runs it on the workers, then the stages move
+	//on together, so which chunk is ready never depends on how fast another one was
+	for(;;)
 	{
-		chunks[i] = new Chunk*[sizeY];
-		for(unsigned int j = 0; j < sizeY; j++)
+		stageTasks.clear();
+		for(unsigned int n = 0; n < loadedChunks.size(); n++)
+		{
+			unsigned int next = loadedChunks[n].stage + 1;
+			if(next <= CHUNK_STAGE_FEATURES && stageReady(n, next))
+			{
+				stageTask_t task = {&loadedChunks[n], next};
+				stageTasks.push_back(task);
+			}
+		}
+		if(stageTasks.empty())
+			return;
+		runStageTasks();
+
+		for(unsigned int t = 0; t < stageTasks.size(); t++)
 		{
-			chunks[i][j] = new Chunk[sizeZ];
-			for(unsigned int k = 0; k < sizeZ; k++)
+			loadedChunk_t &loaded = *stageTasks[t].loaded;
+			loaded.stage = stageTasks[t].stage;
+			if(loaded.stage == CHUNK_STAGE_FEATURES)
 			{
-				chunks[i][j][k] = Chunk(chunkSizeX, chunkSizeY, chunkSizeZ);
-				chunks[i][j][k].setWorldRef(this);
+				//applied by the surface stage, from now on the chunk is written to its region with them
+				if(!saveDirectory.empty())
+					pendingEdits.erase(chunkKey(loaded.x, loaded.y, loaded.z));
+				finishedGeneration(loaded.x, loaded.y, loaded.z);
 			}
 		}
+		spillEdits();
+	}
+}
+
+void motor::World::runStageTasks()
+{
+	//a stage only depends on the seed, the position and the stages before, so the split over the workers does not matter
+	unsigned int jobs = min(workers->getThreadCount(), (unsigned int)stageTasks.size());
+	stageJobs.resize(workers->getThreadCount());
+	for(unsigned int t = 0; t < jobs; t++)
+	{
+		stageJobs[t].world = this;
+		stageJobs[t].first = t;
+		stageJobs[t].step = jobs;
+		workers->add(stageJob, &stageJobs[t]);
+	}
+	workers->wait();
+}
+
+void motor::World::stageJob(void *data)
+{
+	stageJob_t *job = (stageJob_t*)data;
+	const World *world = job->world;
+	for(unsigned int t = job->first; t < world->stageTasks.size(); t += job->step)
+		world->runStage(*world->stageTasks[t].loaded, world->stageTasks[t].stage, job->scratch);
+}
+
+void motor::World::runStage(loadedChunk_t &loaded, unsigned int stage, generateScratch_t &scratch) const
+{
+	switch(stage)
+	{
+		case CHUNK_STAGE_TERRAIN:
+			loaded.heights = new vector<float>();
+			generateTerrain(loaded.chunk, loaded.x, loaded.y, loaded.z, *loaded.heights, scratch);
+			break;
+		case CHUNK_STAGE_SURFACE:
+		{
+			generateSurface(loaded.chunk, loaded.x, loaded.y, loaded.z, *loaded.heights, scratch);
+
+			//the features of the neighbors that were generated first, the map only changes between the waves
+			pendingEditMap_t::const_iterator pending = pendingEdits.find(chunkKey(loaded.x, loaded.y, loaded.z));
+			if(pending != pendingEdits.end())
+				applyEdits(loaded.chunk, pending->second);
+			break;
+		}
+		case CHUNK_STAGE_FEATURES:
+			generateFeatures(loaded, scratch);
+			delete loaded.heights;
+			loaded.heights = NULL;
+			break;
 	}
 }
 
-motor::block_t& motor::World::getBlock(unsigned int x, unsigned int y, unsigned int z)
+//sand only goes into air and dirt only into stone, no feature places what another one may replace,
+//so the edits to a block give the same result in any order and a world does not depend on which
+//chunks were generated first
+static inline bool featureReplaces(unsigned char type, unsigned char current)
 {
-	static block_t outOfBorderBlock = block_t(BLOCK_OOB, 0xFF);
-	if((x >= worldDimX * chunkSizeX || y >= worldDimY * chunkSizeY || z >= worldDimZ * chunkSizeZ))
+	return type == motor::BLOCK_SAND ? current == motor::BLOCK_AIR : current == motor::BLOCK_STONE;
+}
+
+bool motor::World::applyEdits(Chunk *chunk, const featureEdit_t *edits, unsigned int count)
+{
+	bool changed = false;
+	for(unsigned int e = 0; e < count; e++)
 	{
-		//cout << "returning early!" << endl;
-		outOfBorderBlock = block_t(BLOCK_OOB, 0xFF);
-		return outOfBorderBlock;
+		const featureEdit_t &edit = edits[e];
+		if(!featureReplaces(edit.type, chunk->get(edit.x, edit.y, edit.z).type))
+			continue;
+		chunk->set(edit.x, edit.y, edit.z, edit.type);
+		changed = true;
 	}
-	//cout << "normal!" << endl;
-	//cout << "x / 16:" << " y / 16:" << " z / 16:" << " x - ((x/16)*16):" << " y - ((y/16)*16):" << " z - ((z/16)*16):" << endl;
-	//cout <<x / 16 << "  " << y / 16 << "  " << z / 16 << "  " << x - ((x/16)*16) << "  " << y - ((y/16)*16) << "  " << z - ((z/16)*16) << endl;
-	
-	//return block_t(BLOCK_DIRT, 0);
-	return chunks[x / chunkSizeX][y / chunkSizeY][z / chunkSizeZ].get(x - ((x/chunkSizeX)*chunkSizeX), y - ((y/chunkSizeY)*chunkSizeY), z - ((z/chunkSizeZ)*chunkSizeZ));
+	return changed;
 }
 
-motor::block_t& motor::World::getBlock(glm::vec3 v)
+bool motor::World::applyEdits(Chunk *chunk, const pendingEdits_t &pending)
 {
-	return getBlock(floor(v.x), floor(v.y), floor(v.z));
+	bool changed = false;
+	for(unsigned int s = 0; s < pending.sources.size(); s++)
+		if(!pending.sources[s].edits.empty() && applyEdits(chunk, &pending.sources[s].edits[0], pending.sources[s].edits.size()))
+			changed = true;
+	return changed;
 }
 
-void motor::World::setBlock(unsigned int x, unsigned int y, unsigned int z, unsigned int type)
+void motor::World::generateFeatures(const loadedChunk_t &loaded, generateScratch_t &scratch) const
 {
-	if(x > worldDimX * chunkSizeX || y > worldDimY * chunkSizeY || z > worldDimZ * chunkSizeZ)
+	//empty outside of the world and in debug builds
+	if(loaded.heights->empty())
 		return;
-	chunks[x / chunkSizeX][y / chunkSizeY][z / chunkSizeZ].set(x - ((x/chunkSizeX)*chunkSizeX), y - ((y/chunkSizeY)*chunkSizeY), z - ((z/chunkSizeZ)*chunkSizeZ), type);
+
+	//the same numbers are drawn whether a feature fits into the chunk or not
+	Random random(uint32_t(seed), loaded.x, loaded.y, loaded.z, RANDOM_STREAM_FEATURES);
+	int x0 = loaded.x * int(chunkSizeX), y0 = loaded.y * int(chunkSizeY), z0 = loaded.z * int(chunkSizeZ);
+
+	//on the height of the terrain rather than the blocks, mounds of the neighbors do not move them
+	unsigned int mounds = random.nextBelow(FEATURE_MOUNDS + 1);
+	for(unsigned int m = 0; m < mounds; m++)
+	{
+		unsigned int x = random.nextBelow(chunkSizeX), z = random.nextBelow(chunkSizeZ);
+		int rx = 2 + random.nextBelow(3), ry = 1 + random.nextBelow(2), rz = 2 + random.nextBelow(3);
+		int top = int((*loaded.heights)[x * chunkSizeZ + z]);
+		if(top < y0 || top >= y0 + int(chunkSizeY))
+			continue;
+
+		for(int dx = -rx; dx <= rx; dx++)
+			for(int dy = -ry; dy <= ry; dy++)
+				for(int dz = -rz; dz <= rz; dz++)
+					if(float(dx * dx) / float(rx * rx) + float(dy * dy) / float(ry * ry) + float(dz * dz) / float(rz * rz) <= 1.f)
+						placeFeature(loaded, x0 + int(x) + dx, top + dy, z0 + int(z) + dz, BLOCK_SAND, scratch);
+	}
+
+	//two blocks thick, wandering one block per step along every axis
+	unsigned int veins = random.nextBelow(FEATURE_VEINS + 1);
+	for(unsigned int v = 0; v < veins; v++)
+	{
+		int x = x0 + int(random.nextBelow(chunkSizeX));
+		int y = y0 + int(random.nextBelow(chunkSizeY));
+		int z = z0 + int(random.nextBelow(chunkSizeZ));
+		unsigned int length = 1 + random.nextBelow(FEATURE_VEIN_LENGTH);
+		for(unsigned int step = 0; step < length; step++)
+		{
+			for(unsigned int b = 0; b < 8; b++)
+				placeFeature(loaded, x + (b & 1), y + ((b >> 1) & 1), z + (b >> 2), BLOCK_DIRT, scratch);
+			x += int(random.nextBelow(3)) - 1;
+			y += int(random.nextBelow(3)) - 1;
+			z += int(random.nextBelow(3)) - 1;
+		}
+	}
 }
 
-void motor::World::generate()
+void motor::World::placeFeature(const loadedChunk_t &loaded, int x, int y, int z, unsigned char type, generateScratch_t &scratch) const
+{
+	int cx = floorDiv(x, chunkSizeX), cy = floorDiv(y, chunkSizeY), cz = floorDiv(z, chunkSizeZ);
+	featureEdit_t edit = {(unsigned char)(x - cx * int(chunkSizeX)), (unsigned char)(y - cy * int(chunkSizeY)), (unsigned char)(z - cz * int(chunkSizeZ)), type};
+
+	//only the chunk of the stage is written on the workers, the rest goes through spillEdits
+	if(cx == loaded.x && cy == loaded.y && cz == loaded.z)
+		applyEdits(loaded.chunk, &edit, 1);
+	else
+	{
+		spilledEdit_t spilled = {cx, cy, cz, loaded.x, loaded.y, loaded.z, edit};
+		scratch.spilled.push_back(spilled);
+	}
+}
+
+void motor::World::spillEdits()
 {
-	//DEBUG
-	for (int z = 0; z < int(worldDimZ * chunkSizeZ); ++z)
-		for (int x = 0; x < int(worldDimX * chunkSizeX); ++x)
+	//into chunks that have their terrain now, the others get them once they do; without region files
+	//a chunk is generated again after it was unloaded, while the one the edits came from may have stayed,
+	//so they are kept for it even when they could be applied, as they are until a chunk is generated
+	//to the end, before that it is not written to its region
+	vector<uint64_t> replaced; //chunks the current source spilled into, its edits from before are dropped there
+	for(unsigned int j = 0; j < stageJobs.size(); j++)
+	{
+		vector<spilledEdit_t> &spilled = stageJobs[j].scratch.spilled;
+		for(unsigned int e = 0; e < spilled.size(); e++)
 		{
-			for (int y = 0; y < int(worldDimY * chunkSizeY); ++y)
+			//the edits of one source come one after the other
+			const spilledEdit_t &edit = spilled[e];
+			if(e == 0 || edit.sourceX != spilled[e - 1].sourceX || edit.sourceY != spilled[e - 1].sourceY || edit.sourceZ != spilled[e - 1].sourceZ)
+				replaced.clear();
+
+			int n = findChunk(edit.x, edit.y, edit.z);
+			bool applied = n >= 0 && loadedChunks[n].stage >= CHUNK_STAGE_SURFACE;
+			if(applied && applyEdits(loadedChunks[n].chunk, &edit.edit, 1))
+			{
+				loadedChunks[n].unsaved = true;
+				if(loadedChunks[n].stage >= CHUNK_STAGE_FEATURES)
+					markDirty(edit.x, edit.y, edit.z);
+			}
+			if((applied && !saveDirectory.empty() && loadedChunks[n].stage >= CHUNK_STAGE_FEATURES) || edit.y < 0 || edit.y >= int(worldDimY))
+				continue;
+
+			//the region file may have kept edits for the chunk, they are read when it is opened
+			uint64_t key = chunkKey(edit.x, edit.y, edit.z);
+			if(pendingEdits.find(key) == pendingEdits.end())
+				getRegion(edit.x, edit.z);
+			pendingEdits_t &pending = pendingEdits[key];
+			pending.x = edit.x;
+			pending.y = edit.y;
+			pending.z = edit.z;
+			unsigned int s = 0;
+			while(s < pending.sources.size() && (pending.sources[s].x != edit.sourceX || pending.sources[s].y != edit.sourceY || pending.sources[s].z != edit.sourceZ))
+				s++;
+			if(s == pending.sources.size())
+			{
+				sourceEdits_t source = {edit.sourceX, edit.sourceY, edit.sourceZ, vector<featureEdit_t>()};
+				pending.sources.push_back(source);
+			}
+			if(find(replaced.begin(), replaced.end(), key) == replaced.end())
 			{
-				setBlock(x, y, z, BLOCK_AIR);
+				pending.sources[s].edits.clear();
+				replaced.push_back(key);
 			}
+			pending.sources[s].edits.push_back(edit.edit);
 		}
-	//DEBUG
-	memoryAllocationRam = memoryAllocationGfx = 0;
+		spilled.clear();
+	}
+}
+
+void motor::World::finishedGeneration(int x, int y, int z)
+{
+	//its face neighbors meshed their border against nothing so far, and generated chunks
+	//around it may have waited for it to be meshed; the rest gets marked once it is generated
+	markDirty(x, y, z);
+	for(int dx = -1; dx <= 1; dx++)
+		for(int dy = -1; dy <= 1; dy++)
+			for(int dz = -1; dz <= 1; dz++)
+			{
+				int n = findChunk(x + dx, y + dy, z + dz);
+				if(n >= 0 && loadedChunks[n].stage >= CHUNK_STAGE_FEATURES && (abs(dx) + abs(dy) + abs(dz) == 1 || loadedChunks[n].stage < CHUNK_STAGE_MESHED))
+					markDirty(x + dx, y + dy, z + dz);
+			}
+}
+
+void motor::World::addChunk(const loadedChunk_t &loaded)
+{
+	int x = loaded.x, y = loaded.y, z = loaded.z;
+	chunkMap[chunkKey(x, y, z)] = loadedChunks.size();
+	loadedChunks.push_back(loaded);
+	chunkBounds[0].push_back(x * int(chunkSizeX));
+	chunkBounds[1].push_back(y * int(chunkSizeY));
+	chunkBounds[2].push_back(z * int(chunkSizeZ));
+	chunkBounds[3].push_back((x + 1) * int(chunkSizeX));
+	chunkBounds[4].push_back((y + 1) * int(chunkSizeY));
+	chunkBounds[5].push_back((z + 1) * int(chunkSizeZ));
+
+	//read back, but generated before features of its neighbors reached into it
+	pendingEditMap_t::iterator pending = pendingEdits.find(chunkKey(x, y, z));
+	if(pending != pendingEdits.end() && loaded.stage >= CHUNK_STAGE_SURFACE)
+	{
+		if(applyEdits(loaded.chunk, pending->second))
+			loadedChunks.back().unsaved = true;
+		if(!saveDirectory.empty())
+			pendingEdits.erase(pending);
+	}
+
+	if(loaded.stage >= CHUNK_STAGE_FEATURES)
+		finishedGeneration(x, y, z);
+}
+
+void motor::World::unloadChunk(unsigned int n)
+{
+	loadedChunk_t &unloaded = loadedChunks[n];
+	arena.release(unloaded.chunk->allocation);
+	chunkMap.erase(chunkKey(unloaded.x, unloaded.y, unloaded.z));
+	delete unloaded.chunk;
+	delete unloaded.heights;
+
+	//the last chunk takes the place of the unloaded one
+	unsigned int last = loadedChunks.size() - 1;
+	if(n != last)
+	{
+		loadedChunks[n] = loadedChunks[last];
+		chunkMap[chunkKey(loadedChunks[n].x, loadedChunks[n].y, loadedChunks[n].z)] = n;
+		for(unsigned int b = 0; b < 6; b++)
+			chunkBounds[b][n] = chunkBounds[b][last];
+	}
+	loadedChunks.pop_back();
+	for(unsigned int b = 0; b < 6; b++)
+		chunkBounds[b].pop_back();
+}
+
+void motor::World::generateTerrain(Chunk *chunk, int x, int y, int z, vector<float> &heights, generateScratch_t &scratch) const
+{
+	unsigned int count = chunkSizeX * chunkSizeY * chunkSizeZ;
+	scratch.types.resize(count);
+	unsigned char *types = &scratch.types[0];
+
+	//nothing below the ground layer and above the height of the world
+	if(y < 0 || y >= int(worldDimY))
+	{
+		memset(types, BLOCK_AIR, count);
+		chunk->setAll(types);
+		return;
+	}
 
-	float random = 0;
-	int mX, mY;
-	SDL_GetMouseState(&mX, &mY);
-	random = (mX * mY);
-	cout << "random seed: " << random << "\n";
-//#define DEBUG
 #ifndef DEBUG
-	PerlinNoise base(0, 0, 0, 0, random);
-	base.setPersistence(0.4);
-	base.setFrequency(0.4);
-	base.setAmplitude(1.5);
-	base.setOctaves(6);
+	int x0 = x * int(chunkSizeX), y0 = y * int(chunkSizeY), z0 = z * int(chunkSizeZ);
+	unsigned int columns = chunkSizeX * chunkSizeZ;
+	scratch.base.resize(columns);
+	scratch.mountains.resize(columns);
+	base.getHeights(x0, z0, chunkSizeX, chunkSizeZ, &scratch.base[0], &scratch.noise);
+	mountains.getHeights(x0, z0, chunkSizeX, chunkSizeZ, &scratch.mountains[0], &scratch.noise);
 
-	PerlinNoise mountains(0, 0, 0, 0, random);
-	mountains.setPersistence(1.0);
-	mountains.setFrequency(0.1);
-	mountains.setAmplitude(14.5);
-	mountains.setOctaves(1);
+	//the surface of every column first, the 3d noise is only needed where it can reach
+	heights.resize(columns);
+	float highest = 0;
+	for(unsigned int c = 0; c < columns; c++)
+	{
+		float fBase = scratch.base[c];
+		float fMountains = scratch.mountains[c];
 
-	PerlinNoise sand(0.6, 0.15, 0.8, 3, random);
+		float Height = fBase * worldDimY / 4 + worldDimY / 3;
+		Height += fMountains > 0 ? fMountains : 0;
 
-	for (int z = 0; z < int(worldDimZ * chunkSizeZ); ++z)
-		for (int x = 0; x < int(worldDimX * chunkSizeX); ++x)
-		{
-			float fBase = base.getHeight(x, z);
-			float fMountains = mountains.getHeight(x, z);
-			float fSand = sand.getHeight(x, z);
+		if(Height < 0)
+			Height = 1;
+		heights[c] = Height;
+		highest = max(highest, Height);
+	}
 
-			float Height = fBase * worldDimY / 4 + worldDimY / 3;
-			Height += fMountains > 0 ? fMountains : 0;
+	//the density stays within -1 and 1
+	const float *density = NULL;
+	if(caves && y0 < highest + CAVE_OVERHANG + 1)
+	{
+		scratch.density.resize(count);
+		cave.getDensities(x0, y0, z0, chunkSizeX, chunkSizeY, chunkSizeZ, CAVE_STEP, &scratch.density[0], scratch.coarse);
+		density = &scratch.density[0];
+	}
 
-			if(Height < 0)
-				Height = 1;
+	for(unsigned int c = 0; c < columns; c++)
+	{
+		float Height = heights[c];
+		float fMountains = scratch.mountains[c];
 
-			for (int y = 0; y < Height; ++y)
+		unsigned char *column = &types[c * chunkSizeY];
+		for(int j = 0; j < int(chunkSizeY); j++)
+		{
+			bool solid = y0 + j < Height;
+			if(density)
 			{
-				if(fMountains > 1.4)
-					setBlock(x, y, z, BLOCK_DIRT);
-				else if(Height == 1)
-					setBlock(x, y, z, BLOCK_DIRT);
-				else
-					setBlock(x, y, z, BLOCK_STONE);
+				//the surface moves with the density, where that changes with the height it overhangs,
+				//and caverns open where it is high, above the ground layer
+				float d = density[c * chunkSizeY + j];
+				solid = y0 + j < Height + CAVE_OVERHANG * d && (y0 + j < 1 || d < CAVE_THRESHOLD);
 			}
 
-			if(fSand > 0.5)
-				setBlock(x, int(Height), z, BLOCK_SAND);
+			if(!solid)
+				column[j] = BLOCK_AIR;
+			else if(fMountains > 1.4)
+				column[j] = BLOCK_DIRT;
+			else if(Height == 1)
+				column[j] = BLOCK_DIRT;
+			else
+				column[j] = BLOCK_STONE;
 		}
+	}
 #else
-	//for (int z = 0; z < int(worldDimZ * chunkSizeZ); ++z)
-		//for (int x = 0; x < int(worldDimX * chunkSizeX); ++x)
-		//{
-//
-			//float Height = 1;
-			//for (int y = 0; y < Height; ++y)
-			//{
-				//setBlock(x, y, z, BLOCK_STONE);
-			//}
-		//}
-	for (int z = 0; z < int(worldDimZ * chunkSizeZ); ++z)
-		for (int x = 0; x < int(worldDimX * chunkSizeX); ++x)
-		{
-			for (int y = 0; y < int(worldDimY * chunkSizeY); ++y)
-			{
-				setBlock(x, y, z, BLOCK_STONE);
-			}
-		}
+	memset(types, BLOCK_STONE, count);
 #endif
+	chunk->setAll(types);
+}
 
-	unsigned int vertices = 0;
-	for(unsigned int i = 0; i < worldDimX; i++)
-		for(unsigned int j = 0; j < worldDimY; j++)
-			for(unsigned int k = 0; k < worldDimZ; k++)
-			{
-				vertices += chunks[i][j][k].calculateVisibleSides(i * chunkSizeX, j * chunkSizeY, k * chunkSizeZ, false);
-				chunks[i][j][k].uploadToVbo();
+void motor::World::generateSurface(Chunk *chunk, int x, int y, int z, const vector<float> &heights, generateScratch_t &scratch) const
+{
+	//empty outside of the world and in debug builds
+	if(heights.empty())
+		return;
 
-				memoryAllocationRam += chunks[i][j][k].memoryAllocationRam;
-				memoryAllocationGfx += chunks[i][j][k].memoryAllocationGfx;
-			}
-	cout << worldDimX * worldDimY * worldDimZ << " chunks, " << vertices << " vertices, with a ";
-	cout << "total of " << float(memoryAllocationRam) / 1000.f << " kB RAM, " << float(memoryAllocationGfx) / 1000.f << " kB Gfx memory used (probably more :>)" << endl;
+	int x0 = x * int(chunkSizeX), y0 = y * int(chunkSizeY), z0 = z * int(chunkSizeZ);
+	unsigned int columns = chunkSizeX * chunkSizeZ;
+	scratch.sand.resize(columns);
+	sand.getHeights(x0, z0, chunkSizeX, chunkSizeZ, &scratch.sand[0], &scratch.noise);
+
+	//one block of sand at the height of the column, in caves and overhangs as well
+	for(unsigned int c = 0; c < columns; c++)
+	{
+		int sandY = int(heights[c]) - y0;
+		if(scratch.sand[c] > 0.5 && sandY >= 0 && sandY < int(chunkSizeY))
+			chunk->set(c / chunkSizeZ, sandY, c % chunkSizeZ, BLOCK_SAND);
+	}
 }
 
-void motor::World::recalculateChunck(unsigned int x, unsigned int y, unsigned int z)//with block position
+//orders chunk positions by their distance to a center chunk
+struct closerTo
 {
-	//cout << x << " " << y << " " << z << endl;
-	if(x > worldDimX * chunkSizeX || y > worldDimY * chunkSizeY || z > worldDimZ * chunkSizeZ)
+	glm::ivec3 center;
+	closerTo(glm::ivec3 center) : center(center) {}
+	bool operator()(const glm::ivec3 &a, const glm::ivec3 &b) const
+	{
+		glm::ivec3 da = a - center, db = b - center;
+		return da.x * da.x + da.y * da.y + da.z * da.z < db.x * db.x + db.y * db.y + db.z * db.z;
+	}
+};
+
+void motor::World::stream(glm::vec3 center, unsigned int budget)
+{
+	glm::ivec3 chunk(floorDiv(int(floor(center.x)), chunkSizeX), floorDiv(int(floor(center.y)), chunkSizeY), floorDiv(int(floor(center.z)), chunkSizeZ));
+	streamAround(chunk, budget);
+}
+
+void motor::World::streamAround(glm::ivec3 center, unsigned int budget)
+{
+	//nothing to do until the center moves to another column or the last call ran out of budget
+	if(streamComplete && center.x == streamCenter.x && center.z == streamCenter.z)
 		return;
-	chunks[x / chunkSizeX][y / chunkSizeY][z / chunkSizeZ].reCalculateVisibleSides();
-	chunks[x / chunkSizeX][y / chunkSizeY][z / chunkSizeZ].uploadToVbo();
+	streamCenter = center;
+	finishMeshing();
+
+	//only chunks past the radius plus the hysteresis go, so walking back and forth
+	//over the border of the radius does not load and unload the same chunks
+	int radius = streamRadius, keep = streamRadius + streamHysteresis;
+	for(unsigned int n = 0; n < loadedChunks.size(); )
+	{
+		int dx = loadedChunks[n].x - center.x, dz = loadedChunks[n].z - center.z;
+		if(dx * dx + dz * dz > keep * keep)
+		{
+			if(loadedChunks[n].unsaved)
+				writeChunk(loadedChunks[n]);
+			unloadChunk(n); //moves another chunk to n
+		}
+		else
+			n++;
+	}
+	closeRegions(center, keep);
+
+	//without region files the chunks the edits came from are gone this far out, and place them again
+	//when they are generated the next time; with them they are kept, as those are read back instead
+	if(saveDirectory.empty())
+		for(pendingEditMap_t::iterator it = pendingEdits.begin(); it != pendingEdits.end(); )
+		{
+			int dx = it->second.x - center.x, dz = it->second.z - center.z;
+			if(dx * dx + dz * dz > (keep + 2) * (keep + 2))
+				pendingEdits.erase(it++);
+			else
+				it++;
+		}
+
+	streamCandidates.clear();
+	for(int dx = -radius; dx <= radius; dx++)
+		for(int dz = -radius; dz <= radius; dz++)
+		{
+			if(dx * dx + dz * dz > radius * radius)
+				continue;
+			for(int y = 0; y < int(worldDimY); y++)
+				if(findChunk(center.x + dx, y, center.z + dz) < 0)
+					streamCandidates.push_back(glm::ivec3(center.x + dx, y, center.z + dz));
+		}
+	sort(streamCandidates.begin(), streamCandidates.end(), closerTo(center));
+
+	unsigned int loads = min(budget, (unsigned int)streamCandidates.size());
+	loadChunks(loads);
+	streamComplete = loads == streamCandidates.size();
 }
 
-void motor::World::draw(unsigned int positionAttrib, unsigned int texcoordAttrib)
+void motor::World::unloadAll()
 {
-#define _OFFSET(i) ((char *)NULL + (i))
-	//	glPolygonMode(GL_FRONT, GL_LINE);
-	for(unsigned int i = 0; i < worldDimX; i++)
-		for(unsigned int j = 0; j < worldDimY; j++)
-			for(unsigned int k = 0; k < worldDimZ; k++)
-			{
-				glEnableVertexAttribArray(positionAttrib);
-				glEnableVertexAttribArray(texcoordAttrib);
+	finishMeshing();
+	while(!loadedChunks.empty())
+		unloadChunk(loadedChunks.size() - 1);
+	dirtyChunks.clear();
+	closeRegions(streamCenter, -1); //with the pending edits of their chunks
+	pendingEdits.clear();
+	memoryAllocationRam = memoryAllocationGfx = memoryAllocationMesh = 0;
 
-				glBindBuffer(GL_ARRAY_BUFFER, chunks[i][j][k].vertexBuffer);
-				glVertexAttribPointer(positionAttrib, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), _OFFSET(0));
-				glVertexAttribPointer(texcoordAttrib, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_t), _OFFSET(sizeof(glm::vec3)));
-				glDrawArrays(GL_QUADS, 0, chunks[i][j][k].getVertexCount());
-			}
+	//no chunk points into the snapshot any more
+	if(snapshot)
+		munmap(snapshot, snapshotSize);
+	snapshot = NULL;
+	snapshotSize = 0;
+}
+
+void motor::World::seedTerrain()
+{
+	//every noise from its own stream, with one seed they would line up
+	base.set(0.4, 0.4, 1.5, 6, int(Random(uint32_t(seed), RANDOM_STREAM_BASE).next()));
+	mountains.set(1.0, 0.1, 14.5, 1, int(Random(uint32_t(seed), RANDOM_STREAM_MOUNTAINS).next()));
+	sand.set(0.6, 0.15, 0.8, 3, int(Random(uint32_t(seed), RANDOM_STREAM_SAND).next()));
+	cave.set(0.5, 1.0 / 24.0, 2.0 / 3.0, 2, int(Random(uint32_t(seed), RANDOM_STREAM_CAVES).next()));
+}
+
+void motor::World::generate()
+{
+	//the old world is dropped without saving, its regions are kept in the directory of its seed
+	unloadAll();
+
+	//without a seed from setSeed or the save directory, the next one from the clock and the last seed
+	if(!keepSeed)
+		seed = int(Random((uint64_t(time(NULL)) << 32) | uint32_t(seed), RANDOM_STREAM_WORLD).next());
+	keepSeed = false;
+	cout << "seed: " << seed << "\n";
+	if(!saveDirectory.empty())
+	{
+		ofstream seedFile((saveDirectory + "/seed").c_str());
+		seedFile << seed << endl;
+	}
+
+	seedTerrain();
+
+	unsigned int start = SDL_GetTicks();
+	streamComplete = false;
+	streamAround(streamCenter, ~0u);
+	meshLoaded("generated", SDL_GetTicks() - start);
+}
+
+void motor::World::meshLoaded(const char *how, unsigned int ticks)
+{
+	meshAll();
+
+	unsigned int vertices = 0, uniform = 0;
+	for(unsigned int n = 0; n < loadedChunks.size(); n++)
+	{
+		Chunk *chunk = loadedChunks[n].chunk;
+		if(chunk->isUniform())
+			uniform++;
+		vertices += chunk->getVertexCount();
+		memoryAllocationRam += chunk->memoryAllocationRam;
+		memoryAllocationGfx += chunk->memoryAllocationGfx;
+		memoryAllocationMesh += chunk->memoryAllocationMesh;
+	}
+	unsigned int stagingBytes = staging.getBytes();
+	memoryAllocationMesh += stagingBytes;
+	unsigned int uncompressed = loadedChunks.size() * chunkSizeX * chunkSizeY * chunkSizeZ * sizeof(block_t);
+	cout << loadedChunks.size() << " chunks in a radius of " << streamRadius << " " << how << " in " << ticks << " ms, " << vertices << " vertices, with a ";
+	cout << "total of " << float(memoryAllocationRam) / 1000.f << " kB RAM for blocks, " << float(memoryAllocationMesh) / 1000.f << " kB RAM for meshes (";
+	cout << float(stagingBytes) / 1000.f << " kB of it staging), " << float(memoryAllocationGfx) / 1000.f << " kB Gfx memory used by meshes" << endl;
+	arena.printStats();
+	cout << "blocks are palette compressed, as plain block_t they would take " << float(uncompressed) / 1000.f << " kB, " << uniform << " chunks are uniform" << endl;
+}
+
+void motor::World::setSeed(int seed)
+{
+	this->seed = seed;
+	keepSeed = true;
+	seedTerrain();
+}
+
+void motor::World::setSaveDirectory(const string &path)
+{
+	closeRegions(streamCenter, -1);
+	saveDirectory = path;
+	if(path.empty())
+		return;
+	mkdir(path.c_str(), 0755);
+
+	ifstream seedFile((path + "/seed").c_str());
+	keepSeed = bool(seedFile >> seed);
+	if(keepSeed)
+		cout << "continuing the world in " << path << endl;
+}
+
+void motor::World::save()
+{
+	unsigned int saved = 0;
+	for(unsigned int n = 0; n < loadedChunks.size(); n++)
+		if(loadedChunks[n].unsaved)
+		{
+			writeChunk(loadedChunks[n]);
+			saved++;
+		}
+	for(regionMap_t::iterator it = regions.begin(); it != regions.end(); it++)
+		writePendingEdits(it->second);
+	if(saved)
+		cout << "saved " << saved << " chunks to " << saveDirectory << endl;
+}
+
+//snapshot file: a header, one entry per chunk that has its features, the pending edits as in the region
+//files, then the packed voxels of the chunks that are not uniform, exactly as Chunk keeps them in memory;
+//each starts on a cache line and a chunk smaller than a page never crosses one, so touching a chunk
+//faults in as few pages as possible
+static const char SNAPSHOT_MAGIC[4] = {'M', 'S', 'N', 'P'};
+static const uint32_t SNAPSHOT_VERSION = 3;
+static const unsigned int SNAPSHOT_PAGE = 4096;
+
+struct snapshotHeader_t
+{
+	char magic[4];
+	uint32_t version;
+	int32_t seed;
+	uint32_t chunkSize[3];
+	uint32_t voxelCount; //packed indices per chunk, the morton layout pads to a cube
+	uint32_t morton;
+	uint32_t height; //chunks per column
+	int32_t center[3]; //chunk of the last stream call
+	uint32_t chunkCount;
+	uint32_t pendingBytes;
+};
+
+struct snapshotEntry_t
+{
+	int32_t x, y, z;
+	uint32_t bitsPerBlock, paletteSize;
+	uint64_t offset; //of the voxels in the file, 0 if the chunk is uniform
+	unsigned char palette[motor::CHUNK_MAX_PALETTE];
+};
+
+static inline uint64_t snapshotAlign(uint64_t offset, unsigned int bytes)
+{
+	offset = (offset + 63) & ~uint64_t(63);
+	if(bytes >= SNAPSHOT_PAGE || offset / SNAPSHOT_PAGE != (offset + bytes - 1) / SNAPSHOT_PAGE)
+		offset = (offset + SNAPSHOT_PAGE - 1) & ~uint64_t(SNAPSHOT_PAGE - 1);
+	return offset;
+}
+
+bool motor::World::saveSnapshot(const string &path)
+{
+	snapshotHeader_t header;
+	memcpy(header.magic, SNAPSHOT_MAGIC, 4);
+	header.version = SNAPSHOT_VERSION;
+	header.seed = seed;
+	header.chunkSize[0] = chunkSizeX;
+	header.chunkSize[1] = chunkSizeY;
+	header.chunkSize[2] = chunkSizeZ;
+	header.height = worldDimY;
+	header.center[0] = streamCenter.x;
+	header.center[1] = streamCenter.y;
+	header.center[2] = streamCenter.z;
+#ifdef CHUNK_LAYOUT_MORTON
+	header.morton = 1;
+#else
+	header.morton = 0;
+#endif
+
+	//the ones still waiting for their neighbors are generated again after loading, they get their
+	//features from those and the pending edits
+	vector<unsigned int> saved;
+	for(unsigned int n = 0; n < loadedChunks.size(); n++)
+		if(loadedChunks[n].stage >= CHUNK_STAGE_FEATURES)
+			saved.push_back(n);
+	vector<unsigned char> pending;
+	encodePendingEdits(pending, NULL);
+	header.chunkCount = saved.size();
+	header.pendingBytes = pending.size();
+
+	vector<snapshotEntry_t> entries(saved.size());
+	uint64_t offset = sizeof(snapshotHeader_t) + entries.size() * sizeof(snapshotEntry_t) + pending.size();
+	for(unsigned int i = 0; i < saved.size(); i++)
+	{
+		unsigned int n = saved[i];
+		Chunk *chunk = loadedChunks[n].chunk;
+		snapshotEntry_t &entry = entries[i];
+		memset(&entry, 0, sizeof(snapshotEntry_t));
+		entry.x = loadedChunks[n].x;
+		entry.y = loadedChunks[n].y;
+		entry.z = loadedChunks[n].z;
+		entry.bitsPerBlock = chunk->getBitsPerBlock();
+		entry.paletteSize = chunk->getPaletteSize();
+		memcpy(entry.palette, chunk->getPalette(), entry.paletteSize);
+		if(chunk->isUniform())
+			continue;
+		entry.offset = snapshotAlign(offset, chunk->getVoxelBytes());
+		offset = entry.offset + chunk->getVoxelBytes();
+	}
+	Chunk layout(chunkSizeX, chunkSizeY, chunkSizeZ);
+	header.voxelCount = layout.getVoxelCount();
+
+	//a new file renamed over the old one, which may still be mapped by loadSnapshot
+	string written = path + ".new";
+	int file = open(written.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(file < 0)
+	{
+		cout << "could not write snapshot " << path << endl;
+		return false;
+	}
+	bool valid = ftruncate(file, offset) == 0 &&
+			pwrite(file, &header, sizeof(snapshotHeader_t), 0) == sizeof(snapshotHeader_t) &&
+			(entries.empty() || pwrite(file, &entries[0], entries.size() * sizeof(snapshotEntry_t), sizeof(snapshotHeader_t)) == ssize_t(entries.size() * sizeof(snapshotEntry_t))) &&
+			(pending.empty() || pwrite(file, &pending[0], pending.size(), sizeof(snapshotHeader_t) + entries.size() * sizeof(snapshotEntry_t)) == ssize_t(pending.size()));
+	for(unsigned int i = 0; valid && i < saved.size(); i++)
+	{
+		Chunk *chunk = loadedChunks[saved[i]].chunk;
+		if(entries[i].offset)
+			valid = pwrite(file, chunk->getVoxels(), chunk->getVoxelBytes(), entries[i].offset) == ssize_t(chunk->getVoxelBytes());
+	}
+	close(file);
+	if(!valid || rename(written.c_str(), path.c_str()) != 0)
+	{
+		cout << "could not write snapshot " << path << endl;
+		unlink(written.c_str());
+		return false;
+	}
+	cout << "snapshot of " << saved.size() << " chunks written to " << path << ", " << float(offset) / 1000.f << " kB" << endl;
+	return true;
+}
+
+bool motor::World::loadSnapshot(const string &path)
+{
+	int file = open(path.c_str(), O_RDONLY);
+	if(file < 0)
+		return false;
+	unsigned int start = SDL_GetTicks();
+	struct stat info;
+	fstat(file, &info);
+	size_t size = info.st_size;
+	unsigned char *mapped = NULL;
+	if(size >= sizeof(snapshotHeader_t))
+		mapped = (unsigned char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+	close(file);
+	if(mapped == NULL || mapped == MAP_FAILED)
+	{
+		cout << "could not map snapshot " << path << endl;
+		return false;
+	}
+
+	//the voxels are used as they are, so the packing has to be the one of this build
+	const snapshotHeader_t *header = (const snapshotHeader_t*)mapped;
+	Chunk layout(chunkSizeX, chunkSizeY, chunkSizeZ);
+	unsigned int voxelCount = layout.getVoxelCount();
+#ifdef CHUNK_LAYOUT_MORTON
+	uint32_t morton = 1;
+#else
+	uint32_t morton = 0;
+#endif
+	bool valid = memcmp(header->magic, SNAPSHOT_MAGIC, 4) == 0 && header->version == SNAPSHOT_VERSION;
+	valid = valid && header->morton == morton && header->voxelCount == voxelCount;
+	valid = valid && header->chunkSize[0] == chunkSizeX && header->chunkSize[1] == chunkSizeY && header->chunkSize[2] == chunkSizeZ && header->height == worldDimY;
+	valid = valid && header->chunkCount <= (size - sizeof(snapshotHeader_t)) / sizeof(snapshotEntry_t);
+	valid = valid && header->pendingBytes <= size - sizeof(snapshotHeader_t) - header->chunkCount * sizeof(snapshotEntry_t);
+	if(!valid)
+	{
+		cout << "snapshot " << path << " is from another version or world size, ignoring it" << endl;
+		munmap(mapped, size);
+		return false;
+	}
+
+	unloadAll();
+	snapshot = mapped;
+	snapshotSize = size;
+	seed = header->seed;
+	keepSeed = false;
+	seedTerrain();
+	streamCenter = glm::ivec3(header->center[0], header->center[1], header->center[2]);
+	streamComplete = false;
+
+	const snapshotEntry_t *entries = (const snapshotEntry_t*)(mapped + sizeof(snapshotHeader_t));
+	if(!decodePendingEdits(mapped + sizeof(snapshotHeader_t) + header->chunkCount * sizeof(snapshotEntry_t), header->pendingBytes, NULL))
+		cout << "broken pending edits in snapshot " << path << ", features at the borders of its chunks may be missing" << endl;
+	//with a save directory the regions of the chunks they fall into stay open, as when they are spilled
+	vector<glm::ivec2> columns;
+	for(pendingEditMap_t::const_iterator it = pendingEdits.begin(); it != pendingEdits.end(); it++)
+		columns.push_back(glm::ivec2(it->second.x, it->second.z));
+	for(unsigned int n = 0; n < columns.size(); n++)
+		getRegion(columns[n].x, columns[n].y);
+	unsigned int broken = 0;
+	for(unsigned int n = 0; n < header->chunkCount; n++)
+	{
+		const snapshotEntry_t &entry = entries[n];
+		unsigned int bits = entry.bitsPerBlock;
+		valid = (bits == 0 || bits == 1 || bits == 2 || bits == 4 || bits == 8) && entry.paletteSize >= 1 && entry.paletteSize <= (1u << bits);
+		unsigned int bytes = (voxelCount * bits + 7) / 8;
+		if(valid && bits)
+			valid = entry.offset % 64 == 0 && entry.offset >= sizeof(snapshotHeader_t) && entry.offset <= size && bytes <= size - entry.offset;
+		if(!valid || findChunk(entry.x, entry.y, entry.z) >= 0)
+		{
+			broken++;
+			continue;
+		}
+		loadedChunk_t loaded = {new Chunk(chunkSizeX, chunkSizeY, chunkSizeZ), entry.x, entry.y, entry.z, false, CHUNK_STAGE_FEATURES, NULL};
+		loaded.chunk->setWorldRef(this);
+		loaded.chunk->mapVoxels(bits ? mapped + entry.offset : NULL, bits, entry.palette, entry.paletteSize);
+		addChunk(loaded);
+	}
+	if(broken)
+		cout << broken << " broken chunks in snapshot " << path << ", they are streamed in again" << endl;
+	cout << "continuing the snapshot in " << path << ", seed: " << seed << endl;
+	meshLoaded("mapped", SDL_GetTicks() - start);
+	return true;
+}
+
+motor::RegionFile* motor::World::getRegion(int x, int z)
+{
+	if(saveDirectory.empty())
+		return NULL;
+	int rx = floorDiv(x, REGION_SIZE), rz = floorDiv(z, REGION_SIZE);
+	regionMap_t::iterator it = regions.find(chunkKey(rx, 0, rz));
+	if(it != regions.end())
+		return it->second.file;
+
+	//every seed in a directory of its own, so generating another world leaves the saved ones alone
+	stringstream directory, path;
+	directory << saveDirectory << "/" << seed;
+	mkdir(directory.str().c_str(), 0755);
+	path << directory.str() << "/r." << rx << "." << rz << ".region";
+	region_t region = {new RegionFile(), rx, rz};
+	if(!region.file->open(path.str(), seed, chunkSizeX, chunkSizeY, chunkSizeZ, worldDimY))
+	{
+		delete region.file;
+		region.file = NULL;
+	}
+	regions[chunkKey(rx, 0, rz)] = region;
+	readPendingEdits(region);
+	return region.file;
+}
+
+bool motor::World::readChunk(Chunk *chunk, int x, int y, int z)
+{
+	RegionFile *region = getRegion(x, z);
+	generatedTypes.resize(chunkSizeX * chunkSizeY * chunkSizeZ);
+	if(region == NULL || !region->read(x - floorDiv(x, REGION_SIZE) * REGION_SIZE, y, z - floorDiv(z, REGION_SIZE) * REGION_SIZE, &generatedTypes[0]))
+		return false;
+	chunk->setAll(&generatedTypes[0]);
+	return true;
+}
+
+void motor::World::writeChunk(loadedChunk_t &loaded)
+{
+	//one that is not generated to the end is generated again, its pending edits are kept for that
+	if(loaded.stage < CHUNK_STAGE_FEATURES)
+		return;
+	RegionFile *region = getRegion(loaded.x, loaded.z);
+	if(region == NULL)
+		return;
+	generatedTypes.resize(chunkSizeX * chunkSizeY * chunkSizeZ);
+	loaded.chunk->getAll(&generatedTypes[0]);
+	if(region->write(loaded.x - floorDiv(loaded.x, REGION_SIZE) * REGION_SIZE, loaded.y, loaded.z - floorDiv(loaded.z, REGION_SIZE) * REGION_SIZE, &generatedTypes[0]))
+		loaded.unsaved = false;
+}
+
+void motor::World::closeRegions(glm::ivec3 center, int keep)
+{
+	for(regionMap_t::iterator it = regions.begin(); it != regions.end(); )
+	{
+		//from the center to the closest column of the region
+		const region_t &region = it->second;
+		int dx = max(region.x * REGION_SIZE, min(center.x, region.x * REGION_SIZE + REGION_SIZE - 1)) - center.x;
+		int dz = max(region.z * REGION_SIZE, min(center.z, region.z * REGION_SIZE + REGION_SIZE - 1)) - center.z;
+		if(keep >= 0 && dx * dx + dz * dz <= keep * keep)
+		{
+			it++;
+			continue;
+		}
+
+		//the pending edits of its chunks go with it, until it is opened again
+		writePendingEdits(region);
+		for(pendingEditMap_t::iterator pending = pendingEdits.begin(); pending != pendingEdits.end(); )
+		{
+			if(floorDiv(pending->second.x, REGION_SIZE) == region.x && floorDiv(pending->second.z, REGION_SIZE) == region.z)
+				pendingEdits.erase(pending++);
+			else
+				pending++;
+		}
+		delete region.file;
+		regions.erase(it++);
+	}
+}
+
+//pending record of a region file: for every chunk with pending edits its x, y, z and the number of
+//sources, for every source its x, y, z, the number of edits and the edits, as int32 and featureEdit_t
+static void appendInt(vector<unsigned char> &data, int32_t value)
+{
+	data.insert(data.end(), (unsigned char*)&value, (unsigned char*)&value + sizeof(int32_t));
+}
+
+static bool readInt(const unsigned char *data, unsigned int size, unsigned int &at, int32_t &value)
+{
+	if(size - at < sizeof(int32_t))
+		return false;
+	memcpy(&value, data + at, sizeof(int32_t));
+	at += sizeof(int32_t);
+	return true;
+}
+
+bool motor::World::decodePendingEdits(const unsigned char *data, unsigned int size, const region_t *region)
+{
+	unsigned int at = 0;
+	bool valid = true;
+	while(valid && at < size)
+	{
+		int32_t x, y, z, sources;
+		valid = readInt(data, size, at, x) && readInt(data, size, at, y) && readInt(data, size, at, z) && readInt(data, size, at, sources) && sources >= 0;
+		valid = valid && y >= 0 && y < int(worldDimY);
+		valid = valid && (region == NULL || (floorDiv(x, REGION_SIZE) == region->x && floorDiv(z, REGION_SIZE) == region->z));
+		pendingEdits_t pending = {x, y, z, vector<sourceEdits_t>()};
+		for(int32_t s = 0; valid && s < sources; s++)
+		{
+			sourceEdits_t source = {0, 0, 0, vector<featureEdit_t>()};
+			int32_t count;
+			valid = readInt(data, size, at, source.x) && readInt(data, size, at, source.y) && readInt(data, size, at, source.z) && readInt(data, size, at, count);
+			valid = valid && count >= 0 && unsigned(count) <= (size - at) / sizeof(featureEdit_t);
+			if(!valid)
+				break;
+			source.edits.resize(count);
+			if(count)
+				memcpy(&source.edits[0], data + at, count * sizeof(featureEdit_t));
+			at += count * sizeof(featureEdit_t);
+			for(int32_t e = 0; e < count; e++)
+				valid = valid && source.edits[e].x < chunkSizeX && source.edits[e].y < chunkSizeY && source.edits[e].z < chunkSizeZ;
+			pending.sources.push_back(source);
+		}
+		//ones spilled since are newer
+		if(valid)
+			pendingEdits.insert(make_pair(chunkKey(x, y, z), pending));
+	}
+	return valid;
+}
+
+void motor::World::encodePendingEdits(vector<unsigned char> &data, const region_t *region)
+{
+	for(pendingEditMap_t::const_iterator it = pendingEdits.begin(); it != pendingEdits.end(); it++)
+	{
+		const pendingEdits_t &pending = it->second;
+		if(region != NULL && (floorDiv(pending.x, REGION_SIZE) != region->x || floorDiv(pending.z, REGION_SIZE) != region->z))
+			continue;
+		appendInt(data, pending.x);
+		appendInt(data, pending.y);
+		appendInt(data, pending.z);
+		appendInt(data, pending.sources.size());
+		for(unsigned int s = 0; s < pending.sources.size(); s++)
+		{
+			const sourceEdits_t &source = pending.sources[s];
+			appendInt(data, source.x);
+			appendInt(data, source.y);
+			appendInt(data, source.z);
+			appendInt(data, source.edits.size());
+			if(!source.edits.empty())
+				data.insert(data.end(), (const unsigned char*)&source.edits[0], (const unsigned char*)&source.edits[0] + source.edits.size() * sizeof(featureEdit_t));
+		}
+	}
+}
+
+void motor::World::readPendingEdits(const region_t &region)
+{
+	vector<unsigned char> data;
+	if(region.file == NULL || !region.file->readPending(data))
+		return;
+	if(!decodePendingEdits(data.empty() ? NULL : &data[0], data.size(), &region))
+		cout << "broken pending edits in region " << region.x << " " << region.z << ", features at its borders may be missing" << endl;
+}
+
+void motor::World::writePendingEdits(const region_t &region)
+{
+	if(region.file == NULL)
+		return;
+	vector<unsigned char> data;
+	encodePendingEdits(data, &region);
+	region.file->writePending(data);
+}
+
+void motor::World::meshJob(void *data)
+{
+	meshJob_t *job = (meshJob_t*)data;
+	job->chunk->calculateVisibleSides(job->x, job->y, job->z, job->world->greedyMeshing, &job->world->staging);
+
+	SDL_LockMutex(job->world->uploadMutex);
+	job->world->uploadQueue.push_back(job->chunk);
+	SDL_UnlockMutex(job->world->uploadMutex);
+}
+
+void motor::World::meshAll()
+{
+	for(unsigned int n = 0; n < loadedChunks.size(); n++)
+		markDirty(loadedChunks[n].x, loadedChunks[n].y, loadedChunks[n].z);
+	flushDirty();
+	finishMeshing();
+}
+
+void motor::World::finishMeshing()
+{
+	if(!meshing)
+		return;
+	workers->wait();
+	meshing = false;
+	uploadMeshes();
+}
+
+void motor::World::flushDirty()
+{
+	if(dirtyChunks.empty())
+		return;
+
+	//the workers only read blocks, so every chunk can be meshed at the same time; one batch
+	//at a time, as the jobs of the last one point into meshJobs
+	unsigned int ready = 0;
+	for(list<glm::ivec3>::iterator it = dirtyChunks.begin(); it != dirtyChunks.end(); )
+	{
+		//unloaded since, or listed again after it got unloaded and loaded
+		int n = findChunk(it->x, it->y, it->z);
+		if(n < 0 || !loadedChunks[n].chunk->dirty)
+		{
+			it = dirtyChunks.erase(it);
+			continue;
+		}
+		//stays listed until the neighbors it is meshed against are generated
+		if(!stageReady(n, CHUNK_STAGE_MESHED))
+		{
+			it++;
+			continue;
+		}
+		if(ready++ == 0)
+		{
+			finishMeshing();
+			meshJobs.clear();
+		}
+		Chunk *chunk = loadedChunks[n].chunk;
+		chunk->dirty = false;
+		loadedChunks[n].stage = CHUNK_STAGE_MESHED;
+		meshJob_t job = {this, chunk, it->x * int(chunkSizeX), it->y * int(chunkSizeY), it->z * int(chunkSizeZ)};
+		meshJobs.push_back(job);
+		it = dirtyChunks.erase(it);
+	}
+	if(ready == 0)
+		return;
+
+	//uploadMeshes picks the meshes up as they are finished
+	for(unsigned int n = 0; n < meshJobs.size(); n++)
+		workers->add(meshJob, &meshJobs[n]);
+	meshing = true;
+}
+
+void motor::World::uploadMeshes()
+{
+	SDL_LockMutex(uploadMutex);
+	list<Chunk*> finished;
+	finished.swap(uploadQueue);
+	SDL_UnlockMutex(uploadMutex);
+
+	for(list<Chunk*>::iterator it = finished.begin(); it != finished.end(); it++)
+		(*it)->uploadToVbo(arena, &staging);
+}
+
+void motor::World::recalculateChunck(int x, int y, int z)//with block position
+{
+	//cout << x << " " << y << " " << z << endl;
+	markDirty(floorDiv(x, chunkSizeX), floorDiv(y, chunkSizeY), floorDiv(z, chunkSizeZ));
+}
+
+void motor::World::benchmark(unsigned int iterations)
+{
+	cout << "benchmarking chunk layout \"" << CHUNK_LAYOUT_NAME << "\", " << iterations << " iterations" << endl;
+	if(loadedChunks.empty())
+		return;
+
+	benchmarkMeshing(iterations);
+	benchmarkLods();
+	arena.printStats();
+	cout << "last frame: " << drawStats.drawCalls << " draw calls and " << drawStats.stateChanges << " state changes for " << drawStats.chunks << " chunks, " << drawStats.culled << " culled, " << drawStats.occluded << " occluded" << endl;
+	benchmarkGeneration(iterations);
+	benchmarkNoise();
+	benchmarkRegions(iterations);
+	benchmarkLookups(iterations);
+}
+
+void motor::World::copyLoaded(vector<Chunk*> &copies)
+{
+	vector<unsigned char> types(chunkSizeX * chunkSizeY * chunkSizeZ);
+	for(unsigned int c = 0; c < loadedChunks.size(); c++)
+	{
+		Chunk *copy = new Chunk(chunkSizeX, chunkSizeY, chunkSizeZ);
+		copy->setWorldRef(this);
+		loadedChunks[c].chunk->getAll(&types[0]);
+		copy->setAll(&types[0]);
+		copy->setLod(loadedChunks[c].chunk->getLod());
+		copies.push_back(copy);
+	}
+}
+
+void motor::World::benchmarkMeshJob(void *data)
+{
+	meshJob_t *job = (meshJob_t*)data;
+	job->chunk->calculateVisibleSides(job->x, job->y, job->z, job->world->greedyMeshing, &job->world->staging);
+}
+
+void motor::World::benchmarkMeshing(unsigned int iterations)
+{
+	//both meshers on copies of the loaded chunks, which read their neighbors from the world
+	vector<Chunk*> copies;
+	copyLoaded(copies);
+	unsigned int chunkCount = copies.size();
+	for(unsigned int pass = 0; pass < 2; pass++)
+	{
+		bool greedy = pass == 0 ? !greedyMeshing : greedyMeshing;
+		unsigned int vertices = 0;
+		unsigned int start = SDL_GetTicks();
+		for(unsigned int n = 0; n < iterations; n++)
+			for(unsigned int c = 0; c < chunkCount; c++)
+			{
+				const loadedChunk_t &loaded = loadedChunks[c];
+				vertices += copies[c]->calculateVisibleSides(loaded.x * chunkSizeX, loaded.y * chunkSizeY, loaded.z * chunkSizeZ, greedy, &staging);
+			}
+		unsigned int meshTicks = SDL_GetTicks() - start;
+
+		cout << "calculateVisibleSides" << (greedy ? " (greedy): " : " (per face): ") << float(meshTicks) * 1000.f / float(chunkCount * iterations) << " us per chunk, ";
+		cout << vertices / iterations << " vertices, " << float(vertices / iterations * sizeof(chunkVertex_t)) / 1000.f << " kB vbo" << endl;
+	}
+
+	//the same on the workers, without the upload
+	vector<meshJob_t> jobs;
+	for(unsigned int c = 0; c < chunkCount; c++)
+	{
+		const loadedChunk_t &loaded = loadedChunks[c];
+		meshJob_t job = {this, copies[c], loaded.x * int(chunkSizeX), loaded.y * int(chunkSizeY), loaded.z * int(chunkSizeZ)};
+		jobs.push_back(job);
+	}
+	unsigned int start = SDL_GetTicks();
+	for(unsigned int n = 0; n < iterations; n++)
+	{
+		for(unsigned int c = 0; c < chunkCount; c++)
+			workers->add(benchmarkMeshJob, &jobs[c]);
+		workers->wait();
+	}
+	unsigned int poolTicks = SDL_GetTicks() - start;
+	cout << "meshing on " << workers->getThreadCount() << " threads: " << float(poolTicks) * 1000.f / float(chunkCount * iterations) << " us per chunk" << endl;
+
+	for(unsigned int c = 0; c < chunkCount; c++)
+		delete copies[c];
+}
+
+void motor::World::benchmarkLods()
+{
+	//copies of the whole world at every level of detail; the loaded chunks the copies take their neighbors
+	//from are put on the same level for it, a neighbor at another one would give every copy a skirt on all
+	//six faces, their meshes are not touched
+	vector<Chunk*> copies;
+	copyLoaded(copies);
+	unsigned int chunkCount = copies.size();
+	finishMeshing();
+	vector<unsigned int> levels(chunkCount);
+	for(unsigned int c = 0; c < chunkCount; c++)
+		levels[c] = loadedChunks[c].chunk->getLod();
+	for(unsigned int level = 0; level <= CHUNK_MAX_LOD; level++)
+	{
+		for(unsigned int c = 0; c < chunkCount; c++)
+		{
+			copies[c]->setLod(level);
+			loadedChunks[c].chunk->setLod(level);
+		}
+		unsigned int vertices = 0;
+		unsigned int start = SDL_GetTicks();
+		for(unsigned int c = 0; c < chunkCount; c++)
+		{
+			const loadedChunk_t &loaded = loadedChunks[c];
+			vertices += copies[c]->calculateVisibleSides(loaded.x * chunkSizeX, loaded.y * chunkSizeY, loaded.z * chunkSizeZ, greedyMeshing, &staging);
+		}
+		unsigned int meshTicks = SDL_GetTicks() - start;
+		cout << "level of detail " << level << " (" << (1 << copies[0]->getLod()) << "x blocks): " << float(meshTicks) * 1000.f / float(chunkCount) << " us per chunk, " << vertices << " vertices" << endl;
+	}
+
+	for(unsigned int c = 0; c < chunkCount; c++)
+	{
+		loadedChunks[c].chunk->setLod(levels[c]);
+		delete copies[c];
+	}
+}
+
+void motor::World::benchmarkGeneration(unsigned int iterations)
+{
+	//the generation stages of the loaded chunks on this thread and on the workers, into scratch chunks,
+	//the features they spill into the neighbors are dropped
+	unsigned int chunkCount = loadedChunks.size();
+	Chunk scratch(chunkSizeX, chunkSizeY, chunkSizeZ);
+	scratch.setWorldRef(this);
+	generateScratch_t generateScratch;
+	bool cavesWere = caves;
+	for(unsigned int pass = 0; pass < 2; pass++)
+	{
+		caves = pass == 1;
+		unsigned int start = SDL_GetTicks();
+		for(unsigned int n = 0; n < iterations; n++)
+			for(unsigned int c = 0; c < chunkCount; c++)
+			{
+				loadedChunk_t generated = {&scratch, loadedChunks[c].x, loadedChunks[c].y, loadedChunks[c].z, true, CHUNK_STAGE_EMPTY, NULL};
+				runStage(generated, CHUNK_STAGE_TERRAIN, generateScratch);
+				runStage(generated, CHUNK_STAGE_SURFACE, generateScratch);
+				runStage(generated, CHUNK_STAGE_FEATURES, generateScratch);
+				generateScratch.spilled.clear();
+			}
+		unsigned int generateTicks = SDL_GetTicks() - start;
+		cout << (caves ? " with caves " : "generating: ") << float(generateTicks) * 1000.f / float(chunkCount * iterations) << " us per chunk,";
+	}
+	caves = cavesWere;
+	cout << " ";
+
+	vector<loadedChunk_t> generated(chunkCount);
+	unsigned int start = SDL_GetTicks();
+	for(unsigned int n = 0; n < iterations; n++)
+	{
+		for(unsigned int c = 0; c < chunkCount; c++)
+		{
+			loadedChunk_t empty = {new Chunk(chunkSizeX, chunkSizeY, chunkSizeZ), loadedChunks[c].x, loadedChunks[c].y, loadedChunks[c].z, true, CHUNK_STAGE_EMPTY, NULL};
+			generated[c] = empty;
+		}
+		for(unsigned int stage = CHUNK_STAGE_TERRAIN; stage <= CHUNK_STAGE_FEATURES; stage++)
+		{
+			stageTasks.clear();
+			for(unsigned int c = 0; c < chunkCount; c++)
+			{
+				stageTask_t task = {&generated[c], stage};
+				stageTasks.push_back(task);
+			}
+			runStageTasks();
+		}
+		for(unsigned int c = 0; c < chunkCount; c++)
+			delete generated[c].chunk;
+		for(unsigned int j = 0; j < stageJobs.size(); j++)
+			stageJobs[j].scratch.spilled.clear();
+	}
+	stageTasks.clear();
+	unsigned int poolGenerateTicks = SDL_GetTicks() - start;
+	cout << "on " << workers->getThreadCount() << " threads: " << float(poolGenerateTicks) * 1000.f / float(chunkCount * iterations) << " us per chunk" << endl;
+}
+
+void motor::World::benchmarkNoise()
+{
+	//the terrain noises over the columns of the loaded chunks, a sample at a time and batched
+	unsigned int chunkCount = loadedChunks.size();
+	unsigned int columns = chunkSizeX * chunkSizeZ;
+	vector<double> heights(columns);
+	const PerlinNoise *noises[3] = {&base, &mountains, &sand};
+	perlinScratch_t noiseScratch;
+	double sum = 0, batchedSum = 0;
+	unsigned int start = SDL_GetTicks();
+	for(unsigned int c = 0; c < chunkCount; c++)
+	{
+		int x = loadedChunks[c].x * int(chunkSizeX), z = loadedChunks[c].z * int(chunkSizeZ);
+		for(unsigned int n = 0; n < 3; n++)
+			for(int i = 0; i < int(chunkSizeX); i++)
+				for(int k = 0; k < int(chunkSizeZ); k++)
+					sum += noises[n]->getHeight(x + i, z + k);
+	}
+	unsigned int sampleTicks = SDL_GetTicks() - start;
+	start = SDL_GetTicks();
+	for(unsigned int c = 0; c < chunkCount; c++)
+	{
+		int x = loadedChunks[c].x * int(chunkSizeX), z = loadedChunks[c].z * int(chunkSizeZ);
+		for(unsigned int n = 0; n < 3; n++)
+		{
+			noises[n]->getHeights(x, z, chunkSizeX, chunkSizeZ, &heights[0], &noiseScratch);
+			for(unsigned int h = 0; h < columns; h++)
+				batchedSum += heights[h];
+		}
+	}
+	unsigned int batchTicks = SDL_GetTicks() - start;
+	cout << "noise: " << float(sampleTicks) * 1e6f / float(chunkCount * columns * 3) << " ns per sample, batched ";
+	cout << float(batchTicks) * 1e6f / float(chunkCount * columns * 3) << " ns" << (sum == batchedSum ? "" : " (differs!)") << endl;
+}
+
+void motor::World::benchmarkRegions(unsigned int iterations)
+{
+	//the loaded chunks written to a region file of their own next to the save, one after the other, and read back
+	if(saveDirectory.empty())
+		return;
+	string path = saveDirectory + "/benchmark.region";
+	unlink(path.c_str());
+	unsigned int chunkCount = loadedChunks.size();
+	unsigned int perLayer = REGION_SIZE * REGION_SIZE;
+	RegionFile region;
+	if(!region.open(path, seed, chunkSizeX, chunkSizeY, chunkSizeZ, chunkCount / perLayer + 1))
+		return;
+
+	vector<unsigned char> types(chunkSizeX * chunkSizeY * chunkSizeZ);
+	for(unsigned int c = 0; c < chunkCount; c++)
+	{
+		loadedChunks[c].chunk->getAll(&types[0]);
+		region.write(c % REGION_SIZE, c / perLayer, c / REGION_SIZE % REGION_SIZE, &types[0]);
+	}
+
+	Chunk scratch(chunkSizeX, chunkSizeY, chunkSizeZ);
+	scratch.setWorldRef(this);
+	unsigned int read = 0;
+	unsigned int start = SDL_GetTicks();
+	for(unsigned int n = 0; n < iterations; n++)
+		for(unsigned int c = 0; c < chunkCount; c++)
+			if(region.read(c % REGION_SIZE, c / perLayer, c / REGION_SIZE % REGION_SIZE, &types[0]))
+			{
+				scratch.setAll(&types[0]);
+				read++;
+			}
+	unsigned int readTicks = SDL_GetTicks() - start;
+
+	cout << "reading from region files: " << float(readTicks) * 1000.f / float(max(read, 1u)) << " us per chunk (" << read / iterations << " of " << chunkCount << " read), ";
+	cout << float(region.getStoredBytes()) / float(chunkCount) << " bytes per chunk stored" << endl;
+	region.close();
+	unlink(path.c_str());
+}
+
+void motor::World::benchmarkLookups(unsigned int iterations)
+{
+	//walks every loaded chunk through getBlock, the way the collision code looks up blocks
+	unsigned int chunkCount = loadedChunks.size();
+	unsigned int solid = 0;
+	unsigned int lookups = 0;
+	unsigned int start = SDL_GetTicks();
+	for(unsigned int n = 0; n < iterations; n++)
+		for(unsigned int c = 0; c < chunkCount; c++)
+		{
+			int x0 = loadedChunks[c].x * chunkSizeX, y0 = loadedChunks[c].y * chunkSizeY, z0 = loadedChunks[c].z * chunkSizeZ;
+			for(int x = x0; x < x0 + int(chunkSizeX); x++)
+				for(int z = z0; z < z0 + int(chunkSizeZ); z++)
+					for(int y = y0; y < y0 + int(chunkSizeY); y++)
+					{
+						if(getBlock(x, y, z).type != BLOCK_AIR)
+							solid++;
+						lookups++;
+					}
+		}
+	unsigned int lookupTicks = SDL_GetTicks() - start;
+
+	cout << "getBlock: " << (lookupTicks ? float(lookups) / float(lookupTicks) / 1000.f : 0.f) << " million lookups per second";
+	cout << " (" << solid / iterations << " solid)" << endl;
+}
+
+motor::drawStats_t motor::World::getDrawStats()
+{
+	return drawStats;
+}
+
+void motor::World::setCamera(Camera *camera)
+{
+	this->camera = camera;
+}
+
+void motor::World::cullChunks()
+{
+	unsigned int count = loadedChunks.size();
+	if(camera == NULL || count == 0)
+	{
+		chunkVisible.assign(count, 1);
+		return;
+	}
+	chunkVisible.resize(count);
+
+	const glm::vec4 *planes = camera->getFrustumPlanes();
+	const float *bounds[6];
+	for(unsigned int b = 0; b < 6; b++)
+		bounds[b] = &chunkBounds[b][0];
+	AABB::cullFrustum(bounds, count, planes, &chunkVisible[0]);
+}
+
+//the level a chunk at distance gets, level l starts at lodDistance * 2^(l - 1)
+static unsigned int lodForDistance(float distance, float lodDistance)
+{
+	unsigned int level = 0;
+	while(level < motor::CHUNK_MAX_LOD && distance >= lodDistance * (1 << level))
+		level++;
+	return level;
+}
+
+void motor::World::updateLods()
+{
+	if(camera == NULL || lodDistance <= 0 || chunkBounds[0].empty())
+		return;
+
+	//a chunk keeps its level until it is half a chunk past a threshold, so moving
+	//back and forth over one does not remesh it every frame
+	float margin = 0.5f * max(chunkSizeX, max(chunkSizeY, chunkSizeZ));
+	for(unsigned int n = 0; n < loadedChunks.size(); n++)
+	{
+		glm::vec3 center = 0.5f * glm::vec3(chunkBounds[0][n] + chunkBounds[3][n], chunkBounds[1][n] + chunkBounds[4][n], chunkBounds[2][n] + chunkBounds[5][n]);
+		float distance = glm::length(center - camera->position);
+		const loadedChunk_t &loaded = loadedChunks[n];
+		unsigned int level = loaded.chunk->getLod();
+		if(level >= lodForDistance(distance - margin, lodDistance) && level <= lodForDistance(distance + margin, lodDistance))
+			continue;
+		finishMeshing();
+		loaded.chunk->setLod(lodForDistance(distance, lodDistance));
+		if(loaded.chunk->getLod() == level)
+			continue;
+
+		//the neighbors put skirts only along chunks of another level
+		markDirty(loaded.x, loaded.y, loaded.z);
+		for(unsigned int f = 0; f < 6; f++)
+			markDirty(loaded.x + CHUNK_FACE_NORMALS[f][0], loaded.y + CHUNK_FACE_NORMALS[f][1], loaded.z + CHUNK_FACE_NORMALS[f][2]);
+	}
+}
+
+#define _OFFSET(i) ((char *)NULL + (i))
+
+void motor::World::cullOccluded()
+{
+	//breadth first from the chunk of the camera through chunks whose air connects the face it entered
+	//through with the one it leaves through, never turning back towards the camera and only through
+	//chunks in the frustum; the chunks it does not reach are hidden behind solid ones
+	if(camera == NULL || !caveCulling || chunkVisible.empty())
+		return;
+
+	int sizes[3] = {int(chunkSizeX), int(chunkSizeY), int(chunkSizeZ)};
+	int start[3];
+	for(unsigned int a = 0; a < 3; a++)
+		start[a] = int(floor(camera->position[a] / sizes[a]));
+	int startChunk = findChunk(start[0], start[1], start[2]);
+
+	chunkReached.assign(chunkVisible.size(), 0);
+	caveSteps.clear();
+	if(startChunk >= 0)
+	{
+		caveStep_t step = {unsigned(startChunk), 6, 0};
+		caveSteps.push_back(step);
+		chunkReached[startChunk] = 1;
+	}
+	else
+	{
+		//from outside of the loaded chunks, start at every chunk in the frustum that has
+		//no loaded neighbor on a side the camera is on
+		for(unsigned int n = 0; n < loadedChunks.size(); n++)
+		{
+			if(!chunkVisible[n])
+				continue;
+			int p[3] = {loadedChunks[n].x, loadedChunks[n].y, loadedChunks[n].z};
+			for(unsigned int f = 0; f < 6; f++)
+			{
+				int a = 0;
+				while(CHUNK_FACE_NORMALS[f][a] == 0)
+					a++;
+				int sign = CHUNK_FACE_NORMALS[f][a];
+				if(sign > 0 ? start[a] <= p[a] : start[a] >= p[a])
+					continue;
+				if(findChunk(p[0] + CHUNK_FACE_NORMALS[f][0], p[1] + CHUNK_FACE_NORMALS[f][1], p[2] + CHUNK_FACE_NORMALS[f][2]) >= 0)
+					continue;
+				caveStep_t step = {n, f, 1u << CHUNK_FACE_OPPOSITE[f]};
+				caveSteps.push_back(step);
+				chunkReached[n] = 1;
+				break;
+			}
+		}
+	}
+
+	for(unsigned int s = 0; s < caveSteps.size(); s++)
+	{
+		caveStep_t step = caveSteps[s];
+		const loadedChunk_t &loaded = loadedChunks[step.chunk];
+		for(unsigned int f = 0; f < 6; f++)
+		{
+			if(step.directions & (1 << CHUNK_FACE_OPPOSITE[f]))
+				continue;
+			if(step.from < 6 && !loaded.chunk->connects(step.from, f))
+				continue;
+
+			int n = findChunk(loaded.x + CHUNK_FACE_NORMALS[f][0], loaded.y + CHUNK_FACE_NORMALS[f][1], loaded.z + CHUNK_FACE_NORMALS[f][2]);
+			if(n < 0 || chunkReached[n] || !chunkVisible[n])
+				continue;
+
+			chunkReached[n] = 1;
+			caveStep_t next = {unsigned(n), CHUNK_FACE_OPPOSITE[f], step.directions | (1u << f)};
+			caveSteps.push_back(next);
+		}
+	}
+}
+
+void motor::World::initDrawing()
+{
+	drawInitialized = true;
+	useVertexArrays = GLEW_ARB_vertex_array_object || GLEW_VERSION_3_0;
+	useBaseVertex = GLEW_ARB_draw_elements_base_vertex || GLEW_VERSION_3_2;
+	//packed meshes need their chunk origin per draw, the indirect path reads it as a per instance attribute
+	useIndirect = CHUNK_PACKED && chunkOriginAttrib >= 0 && GLEW_VERSION_3_3 && GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance;
+
+	glGenBuffers(1, &quadIndexBuffer);
+	if(useIndirect)
+	{
+		glGenBuffers(1, &indirectBuffer);
+		glGenBuffers(1, &originBuffer);
+	}
+
+	cout << "drawing chunks with ";
+	if(useIndirect)
+		cout << "glMultiDrawElementsIndirect";
+	else if(useBaseVertex && !CHUNK_PACKED)
+		cout << "glMultiDrawElementsBaseVertex";
+	else
+		cout << "one glDrawElements per chunk";
+	cout << (useVertexArrays ? ", one vertex array object per buffer" : "") << endl;
+}
+
+void motor::World::setAttribPointers(unsigned int firstVertex)
+{
+	unsigned int base = firstVertex * sizeof(chunkVertex_t);
+#ifdef CHUNK_PACKED_VERTICES
+	//x, y, z, face and u, v, tile, unused as plain (not normalized) bytes
+	glVertexAttribPointer(positionAttrib, 4, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(packedVertex_t), _OFFSET(base));
+	glVertexAttribPointer(texcoordAttrib, 4, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(packedVertex_t), _OFFSET(base + 4));
+	drawStats.stateChanges += 2;
+#else
+	glVertexAttribPointer(positionAttrib, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), _OFFSET(base));
+	glVertexAttribPointer(texcoordAttrib, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_t), _OFFSET(base + sizeof(glm::vec3)));
+	glVertexAttribPointer(tileAttrib, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_t), _OFFSET(base + sizeof(glm::vec3) + sizeof(glm::vec2)));
+	drawStats.stateChanges += 3;
+#endif
+}
+
+void motor::World::setupVertexArray(unsigned int page)
+{
+	if(vertexArrays.size() <= page)
+		vertexArrays.resize(page + 1, 0);
+	glGenVertexArrays(1, &vertexArrays[page]);
+	glBindVertexArray(vertexArrays[page]);
+
+	glBindBuffer(GL_ARRAY_BUFFER, arena.getBuffer(page));
+	glEnableVertexAttribArray(positionAttrib);
+	glEnableVertexAttribArray(texcoordAttrib);
+#ifndef CHUNK_PACKED_VERTICES
+	glEnableVertexAttribArray(tileAttrib);
+#endif
+	setAttribPointers(0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIndexBuffer);
+
+	if(useIndirect)
+	{
+		//instance n of a multi draw is chunk n of drawOrigins, see baseInstance
+		glBindBuffer(GL_ARRAY_BUFFER, originBuffer);
+		glEnableVertexAttribArray(chunkOriginAttrib);
+		glVertexAttribPointer(chunkOriginAttrib, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), _OFFSET(0));
+		glVertexAttribDivisor(chunkOriginAttrib, 1);
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void motor::World::ensureQuadIndices(unsigned int quads)
+{
+	if(quads <= quadIndexCapacity)
+		return;
+
+	//0 1 2, 0 2 3 for every quad, keeps the winding of the quads;
+	//the vertex arrays reference the buffer by name, so it keeps its name when it grows
+	quadIndexCapacity = max(quads, quadIndexCapacity * 2);
+	vector<GLuint> indices(quadIndexCapacity * 6);
+	for(unsigned int q = 0; q < quadIndexCapacity; q++)
+	{
+		GLuint *index = &indices[q * 6];
+		index[0] = q * 4;
+		index[1] = q * 4 + 1;
+		index[2] = q * 4 + 2;
+		index[3] = q * 4;
+		index[4] = q * 4 + 2;
+		index[5] = q * 4 + 3;
+	}
+	if(useVertexArrays)
+		glBindVertexArray(0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIndexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+	drawStats.stateChanges += 2;
+}
+
+void motor::World::draw(unsigned int positionAttrib, unsigned int texcoordAttrib, unsigned int tileAttrib, int chunkOriginAttrib)
+{
+	//	glPolygonMode(GL_FRONT, GL_LINE);
+	if(!drawInitialized)
+	{
+		this->positionAttrib = positionAttrib;
+		this->texcoordAttrib = texcoordAttrib;
+		this->tileAttrib = tileAttrib;
+		this->chunkOriginAttrib = chunkOriginAttrib;
+		initDrawing();
+	}
+	drawStats.chunks = drawStats.culled = drawStats.occluded = drawStats.drawCalls = drawStats.stateChanges = 0;
+	updateLods();
+	cullChunks();
+	cullOccluded();
+	bool occlusion = camera != NULL && caveCulling;
+
+	//draw lists of the non-empty chunks in the view frustum, one per arena buffer
+	drawLists.resize(arena.getPageCount());
+	for(unsigned int p = 0; p < drawLists.size(); p++)
+	{
+		drawLists[p].counts.clear();
+		drawLists[p].baseVertices.clear();
+		drawLists[p].origins.clear();
+	}
+	unsigned int maxQuads = 0;
+	for(unsigned int n = 0; n < loadedChunks.size(); n++)
+	{
+		const loadedChunk_t &loaded = loadedChunks[n];
+		const arenaAllocation_t &allocation = loaded.chunk->allocation;
+		unsigned int quads = loaded.chunk->getUploadedVertexCount() / 4;
+		if(allocation.capacity == 0 || quads == 0)
+			continue;
+		if(!chunkVisible[n])
+		{
+			drawStats.culled++;
+			continue;
+		}
+		if(occlusion && !chunkReached[n])
+		{
+			drawStats.occluded++;
+			continue;
+		}
+
+		drawList_t &list = drawLists[allocation.page];
+		list.counts.push_back(quads * 6);
+		list.baseVertices.push_back(allocation.first);
+		list.origins.push_back(glm::vec3(loaded.x * int(chunkSizeX), loaded.y * int(chunkSizeY), loaded.z * int(chunkSizeZ)));
+		maxQuads = max(maxQuads, quads);
+		drawStats.chunks++;
+	}
+	if(drawStats.chunks == 0)
+		return;
+	ensureQuadIndices(maxQuads);
+
+	if(useIndirect)
+	{
+		//one command per chunk, baseInstance picks its origin
+		drawCommands.clear();
+		drawOrigins.clear();
+		for(unsigned int p = 0; p < drawLists.size(); p++)
+			for(unsigned int n = 0; n < drawLists[p].counts.size(); n++)
+			{
+				drawCommand_t command = {GLuint(drawLists[p].counts[n]), 1, 0, drawLists[p].baseVertices[n], GLuint(drawOrigins.size())};
+				drawCommands.push_back(command);
+				drawOrigins.push_back(drawLists[p].origins[n]);
+			}
+		glBindBuffer(GL_ARRAY_BUFFER, originBuffer);
+		glBufferData(GL_ARRAY_BUFFER, drawOrigins.size() * sizeof(glm::vec3), &drawOrigins[0], GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, drawCommands.size() * sizeof(drawCommand_t), &drawCommands[0], GL_STREAM_DRAW);
+		drawStats.stateChanges += 4;
+	}
+	else if(!useVertexArrays)
+	{
+		glEnableVertexAttribArray(positionAttrib);
+		glEnableVertexAttribArray(texcoordAttrib);
+#ifndef CHUNK_PACKED_VERTICES
+		glEnableVertexAttribArray(tileAttrib);
+		drawStats.stateChanges++;
+#endif
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIndexBuffer);
+		drawStats.stateChanges += 3;
+	}
+
+	unsigned int command = 0;
+	for(unsigned int p = 0; p < drawLists.size(); p++)
+	{
+		drawList_t &list = drawLists[p];
+		GLsizei count = list.counts.size();
+		if(count == 0)
+			continue;
+
+		if(useVertexArrays)
+		{
+			if(p >= vertexArrays.size() || vertexArrays[p] == 0)
+				setupVertexArray(p);
+			glBindVertexArray(vertexArrays[p]);
+		}
+		else
+			glBindBuffer(GL_ARRAY_BUFFER, arena.getBuffer(p));
+		drawStats.stateChanges++;
+
+		if(useIndirect)
+		{
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, _OFFSET(command * sizeof(drawCommand_t)), count, 0);
+			command += count;
+			drawStats.drawCalls++;
+		}
+		else if(useBaseVertex && !CHUNK_PACKED)
+		{
+			if(drawIndices.size() < list.counts.size())
+				drawIndices.resize(list.counts.size(), NULL);
+			glMultiDrawElementsBaseVertex(GL_TRIANGLES, &list.counts[0], GL_UNSIGNED_INT, &drawIndices[0], count, &list.baseVertices[0]);
+			drawStats.drawCalls++;
+		}
+		else
+			for(GLsizei n = 0; n < count; n++)
+			{
+				if(CHUNK_PACKED && chunkOriginAttrib >= 0)
+				{
+					glVertexAttrib3f(chunkOriginAttrib, list.origins[n].x, list.origins[n].y, list.origins[n].z);
+					drawStats.stateChanges++;
+				}
+				if(useBaseVertex)
+					glDrawElementsBaseVertex(GL_TRIANGLES, list.counts[n], GL_UNSIGNED_INT, NULL, list.baseVertices[n]);
+				else
+				{
+					setAttribPointers(list.baseVertices[n]);
+					glDrawElements(GL_TRIANGLES, list.counts[n], GL_UNSIGNED_INT, NULL);
+				}
+				drawStats.drawCalls++;
+			}
+	}
+
+	if(useVertexArrays)
+		glBindVertexArray(0);
+	if(useIndirect)
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 }
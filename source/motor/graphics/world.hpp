@@ -3,10 +3,15 @@
 
 #include <list>
 #include <iostream>
+#include <tr1/unordered_map>
 using namespace std;
 
 #include "motor/graphics/chunk.hpp"
+#include "motor/io/regionFile.hpp"
 #include "motor/math/perlinNoise.hpp"
+#include "motor/math/gradientNoise.hpp"
+#include "motor/math/random.hpp"
+#include "motor/utility/threadPool.hpp"
 
 #include "motor/math/glm/glm.hpp"
 
@@ -14,28 +19,282 @@ using namespace std;
 
 namespace motor
 {
+	//what World::draw submitted for the last frame
+	typedef struct drawStats_t
+	{
+		unsigned int chunks; //non-empty chunks drawn
+		unsigned int culled; //non-empty chunks outside of the view frustum
+		unsigned int occluded; //non-empty chunks in the frustum the cave culling found no way to
+		unsigned int drawCalls;
+		unsigned int stateChanges; //binds, enables, attribute pointers and values, buffer uploads
+	} drawStats_t;
+
+	//how far a chunk got through generation, every stage builds on the one before
+	enum chunkStageEnum
+	{
+		CHUNK_STAGE_EMPTY = 0,
+		CHUNK_STAGE_TERRAIN, //stone, dirt and caves
+		CHUNK_STAGE_SURFACE, //sand on top
+		CHUNK_STAGE_FEATURES, //decorations, these may reach into the neighbors
+		CHUNK_STAGE_MESHED //drawable
+	};
+
+	class Camera;
 	class World
 	{
 		public:
 			World();
-			void load(unsigned int sizeX, unsigned int sizeY, unsigned int sizeZ, unsigned int chunkSizeX = 16, unsigned int chunkSizeY = 16, unsigned int chunkSizeZ = 16);
-			void generate();
-			void recalculateChunck(unsigned int x, unsigned int y, unsigned int z);//with block position
-			void draw(unsigned int, unsigned int);
+			~World();
+			//radius in chunks around the streaming center that is kept loaded along x and z, sizeY chunks from y = 0 up
+			void load(unsigned int radius, unsigned int sizeY, unsigned int chunkSizeX = 16, unsigned int chunkSizeY = 16, unsigned int chunkSizeZ = 16);
+			void generate();//new seed, drops every chunk and loads the whole radius around the last center again
+			void setSeed(int seed);//of the chunks streamed in from now on and the next generate(), which otherwise picks a new one
+			//chunks are read from region files in path instead of generated and written back when they
+			//are unloaded or saved; the first generate() after this continues the world saved there,
+			//every other one picks a new seed, whose regions go to a directory of their own in path
+			void setSaveDirectory(const string &path);
+			void save();//writes every chunk that was generated or changed since it was read, and the pending feature edits
+			//writes the loaded chunks that have their features, with their voxels page aligned and in the packed
+			//layout they have in memory, so loadSnapshot maps them instead of reading or generating them, and
+			//the pending feature edits; the other chunks are generated again after loading
+			bool saveSnapshot(const string &path);
+			//drops every chunk and maps the ones of the snapshot copy on write, the file never changes;
+			//chunks outside of it stream in as usual; false if it is missing or from another chunk size or layout
+			bool loadSnapshot(const string &path);
+			//loads missing chunks in the radius around center, nearest first and at most budget of them,
+			//and drops the ones further away than the radius plus the hysteresis, call once per frame
+			void stream(glm::vec3 center, unsigned int budget = 16);
+			void setHysteresis(unsigned int chunks);
+			unsigned int getLoadedChunkCount();
+			unsigned int getPendingEditCount();//feature blocks kept for chunks that are not generated yet, or generated again
+			void recalculateChunck(int x, int y, int z);//with block position, remeshed on the next flushDirty
+			void flushDirty();//starts meshing every chunk that changed since the last call, once, and returns
+			void uploadMeshes();//uploads the meshes the workers finished, call from the thread that owns the gl context
+			void draw(unsigned int positionAttrib, unsigned int texcoordAttrib, unsigned int tileAttrib, int chunkOriginAttrib);
+			drawStats_t getDrawStats();
+			void setCamera(Camera *camera);//draw culls against its frustum, NULL draws everything
+			void benchmark(unsigned int iterations = 10);//prints meshing, generation, storage and lookup throughput, the world stays as it is
+
+			block_t getBlock(int x, int y, int z);//BLOCK_OOB where no chunk is loaded
+			block_t getBlock(glm::vec3 v);
+			void setBlock(int x, int y, int z, unsigned int type);
+			Chunk* getChunk(int x, int y, int z);//with chunk position, NULL if it is not loaded
 
-			block_t& getBlock(unsigned int x, unsigned int y, unsigned int z);
-			block_t& getBlock(glm::vec3 v);
-			void setBlock(unsigned int x, unsigned int y, unsigned int z, unsigned int type);
+			void setGreedyMeshing(bool greedy);
+			void setCaveCulling(bool caves);//skip chunks the camera can not see through air, needs a camera
+			void setLodDistance(float distance);//in blocks, meshes get coarser at 1x, 2x and 4x of it, 0 keeps full detail
+			void setCaves(bool caves);//3d noise carves caves and overhangs into the chunks generated from now on
+			void setHeadless(bool headless);//nothing is meshed or uploaded, for tests and tools without a gl context
 
 			unsigned int memoryAllocationGfx;
 			unsigned int memoryAllocationRam;
+			unsigned int memoryAllocationMesh; //cpu side of the meshes, including the staging pool
 
 		private:
-			Chunk ***chunks;
-			//prolly later list<Chunk> chunks;
-			//module::Perlin perlin;
-			unsigned int worldDimX, worldDimY, worldDimZ; //in chunks
+			struct meshJob_t
+			{
+				World *world;
+				Chunk *chunk;
+				int x, y, z; //in blocks
+			};
+			struct loadedChunk_t
+			{
+				Chunk *chunk;
+				int x, y, z; //in chunks
+				bool unsaved; //generated or changed since it was read from or written to its region file
+				unsigned char stage; //chunkStageEnum
+				vector<float> *heights; //of every column, from the terrain to the features stage, NULL otherwise
+			};
+			//a block a feature places, in the chunk it falls into
+			struct featureEdit_t
+			{
+				unsigned char x, y, z, type;
+			};
+			//one that falls into another chunk, at x, y, z in chunks, from the one at sourceX, sourceY, sourceZ
+			struct spilledEdit_t
+			{
+				int x, y, z;
+				int sourceX, sourceY, sourceZ;
+				featureEdit_t edit;
+			};
+			//the ones a chunk spilled into another, replaced when it is generated again and spills them once more
+			struct sourceEdits_t
+			{
+				int x, y, z; //of the source, in chunks
+				vector<featureEdit_t> edits;
+			};
+			//the ones waiting for the terrain of a chunk that is not loaded or generated yet
+			struct pendingEdits_t
+			{
+				int x, y, z; //in chunks
+				vector<sourceEdits_t> sources;
+			};
+			//chunkKey of the chunk they fall into
+			typedef tr1::unordered_map<uint64_t, pendingEdits_t> pendingEditMap_t;
+			//working memory of the generation stages
+			struct generateScratch_t
+			{
+				vector<unsigned char> types;
+				vector<double> base, mountains, sand; //noise of every column, in types order
+				vector<float> density, coarse; //of the caves
+				vector<spilledEdit_t> spilled; //of the features stage, handed out by spillEdits
+				perlinScratch_t noise;
+			};
+			//a chunk that runs stage in the current wave of advanceStages
+			struct stageTask_t
+			{
+				loadedChunk_t *loaded;
+				unsigned int stage;
+			};
+			//runs every step-th of the stageTasks, from first on
+			struct stageJob_t
+			{
+				World *world;
+				unsigned int first, step;
+				generateScratch_t scratch; //kept between calls
+			};
+			//chunkKey to the index in loadedChunks
+			typedef tr1::unordered_map<uint64_t, unsigned int> chunkMap_t;
+			struct region_t
+			{
+				RegionFile *file; //NULL if it could not be opened
+				int x, z; //in regions
+			};
+			//chunkKey of the region position
+			typedef tr1::unordered_map<uint64_t, region_t> regionMap_t;
+			//a glMultiDrawElementsIndirect command
+			struct drawCommand_t
+			{
+				GLuint count, instanceCount, firstIndex;
+				GLint baseVertex;
+				GLuint baseInstance;
+			};
+			//the non-empty chunks in one arena buffer, as the multi draw calls want them
+			struct drawList_t
+			{
+				vector<GLsizei> counts; //in indices
+				vector<GLint> baseVertices;
+				vector<glm::vec3> origins;
+			};
+
+			static void meshJob(void *data);
+			static void benchmarkMeshJob(void *data);//meshJob without the upload
+			void copyLoaded(vector<Chunk*> &copies);//of the loaded chunks, new, meshing them leaves the loaded ones alone
+			void benchmarkMeshing(unsigned int iterations);
+			void benchmarkLods();
+			void benchmarkGeneration(unsigned int iterations);
+			void benchmarkNoise();
+			void benchmarkRegions(unsigned int iterations);//only with a save directory, in a file of its own there
+			void benchmarkLookups(unsigned int iterations);
+			static uint64_t chunkKey(int x, int y, int z);
+			int findChunk(int x, int y, int z);//index in loadedChunks, -1 if not loaded
+			void loadChunks(unsigned int count);//the first count streamCandidates
+			//runs the generation stages of the loaded chunks on the workers until none is ready for its next one
+			void advanceStages();
+			//whether the chunk at n can run stage, its neighbors that will be streamed in may have to get there first
+			bool stageReady(unsigned int n, unsigned int stage);
+			void runStageTasks();
+			static void stageJob(void *data);
+			void runStage(loadedChunk_t &loaded, unsigned int stage, generateScratch_t &scratch) const;
+			void finishedGeneration(int x, int y, int z);//marks the chunk and the neighbors waiting for it dirty
+			void spillEdits();//the features of the last wave that fell into other chunks, to them or their pendingEdits
+			static bool applyEdits(Chunk *chunk, const featureEdit_t *edits, unsigned int count);//true if a block changed
+			static bool applyEdits(Chunk *chunk, const pendingEdits_t &pending);
+			//the pending edits of the chunks in a region live in its file while it is closed
+			//in the format of the pending record of the region files, of the chunks in region or of all if it is NULL
+			bool decodePendingEdits(const unsigned char *data, unsigned int size, const region_t *region);
+			void encodePendingEdits(vector<unsigned char> &data, const region_t *region);
+			void readPendingEdits(const region_t &region);
+			void writePendingEdits(const region_t &region);
+			void addChunk(const loadedChunk_t &loaded);
+			void unloadAll();//without saving, also closes the regions and the snapshot
+			void seedTerrain();
+			void meshLoaded(const char *how, unsigned int ticks);//meshes the loaded chunks and prints their memory use
+			void unloadChunk(unsigned int n);
+			void generateTerrain(Chunk *chunk, int x, int y, int z, vector<float> &heights, generateScratch_t &scratch) const;
+			void generateSurface(Chunk *chunk, int x, int y, int z, const vector<float> &heights, generateScratch_t &scratch) const;
+			void generateFeatures(const loadedChunk_t &loaded, generateScratch_t &scratch) const;
+			void placeFeature(const loadedChunk_t &loaded, int x, int y, int z, unsigned char type, generateScratch_t &scratch) const;//x, y, z in blocks
+			RegionFile* getRegion(int x, int z);//of the chunk column, NULL without a save directory
+			bool readChunk(Chunk *chunk, int x, int y, int z);
+			void writeChunk(loadedChunk_t &loaded);
+			void closeRegions(glm::ivec3 center, int keep);//the ones with no column closer than keep chunks
+			void streamAround(glm::ivec3 center, unsigned int budget);
+			void meshAll();//waits until everything is meshed and uploaded
+			void finishMeshing();//waits for the meshes flushDirty started and uploads them
+			void markDirty(int x, int y, int z);//with chunk position
+			void initDrawing();
+			void setupVertexArray(unsigned int page);
+			void setAttribPointers(unsigned int firstVertex);
+			void ensureQuadIndices(unsigned int quads);
+			void cullChunks();
+			void cullOccluded();
+			void updateLods();
+
+			vector<loadedChunk_t> loadedChunks; //in no particular order, unloading moves the last one into the gap
+			chunkMap_t chunkMap;
+			unsigned int worldDimY; //in chunks
 			unsigned int chunkSizeX, chunkSizeY, chunkSizeZ; //in blocks
+			bool greedyMeshing;
+
+			unsigned int streamRadius, streamHysteresis; //in chunks
+			glm::ivec3 streamCenter; //chunk of the last stream call
+			bool streamComplete; //everything in the radius around streamCenter is loaded
+			vector<glm::ivec3> streamCandidates;
+			vector<stageTask_t> stageTasks;
+			vector<stageJob_t> stageJobs; //one per worker
+			pendingEditMap_t pendingEdits;
+			PerlinNoise base, mountains, sand;
+			GradientNoise cave;
+			bool caves;
+			vector<unsigned char> generatedTypes; //scratch of the region reads and writes
+			int seed;
+			bool keepSeed; //the next generate() continues the saved world
+
+			string saveDirectory;
+			regionMap_t regions;
+			unsigned char *snapshot; //private mapping the voxels of the snapshot chunks point into, NULL without one
+			size_t snapshotSize;
+
+			ThreadPool *workers; //meshes and generates chunks
+			vector<meshJob_t> meshJobs; //of the batch the workers are meshing, kept until it is finished
+			bool headless;
+			bool meshing; //until finishMeshing the workers read the chunks and their neighbors, nothing may change them
+			list<glm::ivec3> dirtyChunks;
+			list<Chunk*> uploadQueue;
+			SDL_mutex *uploadMutex;
+			VertexArena arena; //shared vbos all chunk meshes are sub-allocated from
+			MeshStaging staging; //mesher scratch and vertex arrays, reused between meshes
+
+			bool drawInitialized;
+			bool useVertexArrays, useBaseVertex, useIndirect; //what the gl implementation supports
+			unsigned int positionAttrib, texcoordAttrib, tileAttrib;
+			int chunkOriginAttrib;
+			vector<unsigned int> vertexArrays; //one per arena buffer, 0 until first drawn
+			unsigned int quadIndexBuffer, quadIndexCapacity; //two triangles per quad, capacity in quads
+			unsigned int indirectBuffer, originBuffer;
+			vector<drawList_t> drawLists;
+			vector<drawCommand_t> drawCommands;
+			vector<glm::vec3> drawOrigins;
+			vector<GLvoid*> drawIndices; //all NULL, every chunk starts at index 0
+			drawStats_t drawStats;
+
+			Camera *camera;
+			vector<float> chunkBounds[6]; //min x, y, z, max x, y, z of every chunk, in loadedChunks order
+			vector<unsigned char> chunkVisible; //same order, filled by cullChunks
+
+			//a chunk the cave culling walked into, through the face it came from and
+			//with the directions it went in so far (bits in CHUNK_FACE_NORMALS order)
+			struct caveStep_t
+			{
+				unsigned int chunk; //in loadedChunks
+				unsigned int from, directions;
+			};
+			bool caveCulling;
+			vector<caveStep_t> caveSteps;
+			vector<unsigned char> chunkReached;
+
+			float lodDistance;
 	};
 }
 
@@ -0,0 +1,250 @@
+#include "regionFile.hpp"
+#include "motor/utility/compression.hpp"
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char REGION_MAGIC[4] = {'M', 'R', 'G', 'N'};
+static const uint32_t REGION_VERSION = 3; //2: terrain seeded through motor::Random, 3: pending record
+static const unsigned int REGION_SECTOR = 256; //chunks start on a sector, so a rewrite that does not grow past it stays in place
+
+static inline unsigned int sectorCeil(unsigned int bytes)
+{
+	return (bytes + REGION_SECTOR - 1) & ~(REGION_SECTOR - 1);
+}
+
+motor::RegionFile::RegionFile()
+{
+	file = -1;
+	mapped = NULL;
+	mappedSize = fileSize = 0;
+	chunkBytes = 0;
+}
+
+motor::RegionFile::~RegionFile()
+{
+	close();
+}
+
+bool motor::RegionFile::open(const string &path, unsigned int seed, unsigned int chunkSizeX, unsigned int chunkSizeY, unsigned int chunkSizeZ, unsigned int height)
+{
+	close();
+	file = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if(file < 0)
+	{
+		cout << "could not open region file " << path << endl;
+		return false;
+	}
+	chunkBytes = chunkSizeX * chunkSizeY * chunkSizeZ;
+	table.assign(REGION_SIZE * REGION_SIZE * height + 1, entry_t()); //the pending record last
+	unsigned int tableBytes = table.size() * sizeof(entry_t);
+
+	struct stat info;
+	fstat(file, &info);
+	fileSize = info.st_size;
+	bool valid = fileSize >= sizeof(header_t) + tableBytes && pread(file, &header, sizeof(header_t), 0) == sizeof(header_t);
+	valid = valid && memcmp(header.magic, REGION_MAGIC, 4) == 0 && header.version == REGION_VERSION && header.seed == seed;
+	valid = valid && header.chunkSize[0] == chunkSizeX && header.chunkSize[1] == chunkSizeY && header.chunkSize[2] == chunkSizeZ && header.height == height;
+	if(valid)
+		valid = pread(file, &table[0], tableBytes, sizeof(header_t)) == ssize_t(tableBytes);
+
+	if(!valid && fileSize > 0)
+	{
+		cout << "region file " << path << " is from another world or version, not touching it" << endl;
+		close();
+		return false;
+	}
+	if(!valid)
+	{
+		memcpy(header.magic, REGION_MAGIC, 4);
+		header.version = REGION_VERSION;
+		header.seed = seed;
+		header.chunkSize[0] = chunkSizeX;
+		header.chunkSize[1] = chunkSizeY;
+		header.chunkSize[2] = chunkSizeZ;
+		header.height = height;
+		header.unused = 0;
+		table.assign(table.size(), entry_t());
+		fileSize = sectorCeil(sizeof(header_t) + tableBytes);
+		if(ftruncate(file, fileSize) != 0 ||
+				pwrite(file, &header, sizeof(header_t), 0) != sizeof(header_t) ||
+				pwrite(file, &table[0], tableBytes, sizeof(header_t)) != ssize_t(tableBytes))
+		{
+			cout << "could not create region file " << path << endl;
+			close();
+			return false;
+		}
+	}
+
+	//the free sectors are the ones no entry points into
+	sectors.assign(fileSize / REGION_SECTOR, false);
+	markSectors(0, sizeof(header_t) + tableBytes, true);
+	for(unsigned int i = 0; i < table.size(); i++)
+		if(table[i].size && table[i].offset % REGION_SECTOR == 0 && table[i].offset <= fileSize && table[i].size <= fileSize - table[i].offset)
+			markSectors(table[i].offset, table[i].size, true);
+	return map();
+}
+
+void motor::RegionFile::close()
+{
+	if(mapped)
+		munmap(mapped, mappedSize);
+	mapped = NULL;
+	mappedSize = 0;
+	if(file >= 0)
+		::close(file);
+	file = -1;
+}
+
+bool motor::RegionFile::map()
+{
+	if(mapped)
+		munmap(mapped, mappedSize);
+	mapped = (unsigned char*)mmap(NULL, fileSize, PROT_READ, MAP_SHARED, file, 0);
+	if(mapped == MAP_FAILED)
+	{
+		mapped = NULL;
+		mappedSize = 0;
+		return false;
+	}
+	mappedSize = fileSize;
+	return true;
+}
+
+unsigned int motor::RegionFile::entryIndex(int x, int y, int z)
+{
+	return (x * REGION_SIZE + z) * header.height + y;
+}
+
+void motor::RegionFile::markSectors(unsigned int offset, unsigned int size, bool used)
+{
+	unsigned int end = min((unsigned int)sectors.size(), sectorCeil(offset + size) / REGION_SECTOR);
+	for(unsigned int i = offset / REGION_SECTOR; i < end; i++)
+		sectors[i] = used;
+}
+
+unsigned int motor::RegionFile::allocateSectors(unsigned int count)
+{
+	//a run that ends at the end of the file can be grown
+	unsigned int run = 0;
+	for(unsigned int i = 0; i < sectors.size(); i++)
+	{
+		run = sectors[i] ? 0 : run + 1;
+		if(run == count)
+			return (i + 1 - count) * REGION_SECTOR;
+	}
+	return (sectors.size() - run) * REGION_SECTOR;
+}
+
+bool motor::RegionFile::read(int x, int y, int z, unsigned char *types)
+{
+	if(file < 0 || x < 0 || z < 0 || y < 0 || x >= REGION_SIZE || z >= REGION_SIZE || y >= int(header.height))
+		return false;
+	const entry_t &entry = table[entryIndex(x, y, z)];
+	if(entry.size < sizeof(uint32_t) || entry.offset > fileSize || entry.size > fileSize - entry.offset)
+		return false;
+	if(entry.offset + entry.size > mappedSize && !map())
+		return false;
+
+	//the size of the run length encoding, then its lz compression;
+	//a run takes at least two bytes, so no valid encoding is larger than two per block
+	const unsigned char *record = mapped + entry.offset;
+	uint32_t rleSize;
+	memcpy(&rleSize, record, sizeof(uint32_t));
+	bool valid = rleSize <= 2 * chunkBytes;
+	if(valid)
+	{
+		rle.resize(rleSize + 1);
+		valid = lzDecompress(record + sizeof(uint32_t), entry.size - sizeof(uint32_t), &rle[0], rleSize) && rleDecode(&rle[0], rleSize, types, chunkBytes);
+	}
+	if(!valid)
+	{
+		cout << "broken chunk " << x << " " << y << " " << z << " in a region file, generating it again" << endl;
+		return false;
+	}
+	return true;
+}
+
+bool motor::RegionFile::write(int x, int y, int z, const unsigned char *types)
+{
+	if(file < 0 || x < 0 || z < 0 || y < 0 || x >= REGION_SIZE || z >= REGION_SIZE || y >= int(header.height))
+		return false;
+	rleEncode(types, chunkBytes, rle);
+	lzCompress(&rle[0], rle.size(), lz);
+	uint32_t rleSize = rle.size();
+	return writeRecord(entryIndex(x, y, z), &rleSize, sizeof(uint32_t), &lz[0], lz.size());
+}
+
+bool motor::RegionFile::readPending(vector<unsigned char> &data)
+{
+	data.clear();
+	if(file < 0)
+		return false;
+	const entry_t &entry = table.back();
+	if(entry.size == 0)
+		return true;
+	if(entry.offset > fileSize || entry.size > fileSize - entry.offset || (entry.offset + entry.size > mappedSize && !map()))
+		return false;
+	data.assign(mapped + entry.offset, mapped + entry.offset + entry.size);
+	return true;
+}
+
+bool motor::RegionFile::writePending(const vector<unsigned char> &data)
+{
+	if(file < 0)
+		return false;
+	if(data.empty() && table.back().size == 0)
+		return true;
+	return writeRecord(table.size() - 1, NULL, 0, data.empty() ? NULL : &data[0], data.size());
+}
+
+bool motor::RegionFile::writeRecord(unsigned int index, const void *head, unsigned int headSize, const void *body, unsigned int bodySize)
+{
+	unsigned int size = headSize + bodySize;
+
+	//in place if it still fits the sectors of the old version, else in the first free sectors it fits,
+	//which the old version is not in, as it is still marked; an empty record frees them
+	entry_t &entry = table[index];
+	entry_t written = entry;
+	if(size == 0)
+		written.offset = 0;
+	else if(entry.size == 0 || sectorCeil(size) > sectorCeil(entry.size))
+	{
+		written.offset = allocateSectors(sectorCeil(size) / REGION_SECTOR);
+		if(written.offset + sectorCeil(size) > fileSize)
+		{
+			if(ftruncate(file, written.offset + sectorCeil(size)) != 0)
+				return false;
+			fileSize = written.offset + sectorCeil(size);
+			sectors.resize(fileSize / REGION_SECTOR, false);
+		}
+	}
+	written.size = size;
+	if((headSize && pwrite(file, head, headSize, written.offset) != ssize_t(headSize)) ||
+			(bodySize && pwrite(file, body, bodySize, written.offset + headSize) != ssize_t(bodySize)))
+		return false;
+
+	//the table entry last, so an interrupted append leaves the old version readable
+	if(pwrite(file, &written, sizeof(entry_t), sizeof(header_t) + index * sizeof(entry_t)) != sizeof(entry_t))
+		return false;
+
+	//the sectors the old version does not share with the new one are free once the table points away from them
+	if(entry.size)
+		markSectors(entry.offset, entry.size, false);
+	markSectors(written.offset, written.size, true);
+	entry = written;
+	return true;
+}
+
+unsigned int motor::RegionFile::getStoredBytes()
+{
+	unsigned int bytes = 0;
+	for(unsigned int i = 0; i + 1 < table.size(); i++)
+		bytes += table[i].size;
+	return bytes;
+}
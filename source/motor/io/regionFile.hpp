@@ -0,0 +1,70 @@
+#ifndef _REGIONFILE_HPP
+#define _REGIONFILE_HPP
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+using namespace std;
+
+namespace motor
+{
+	//chunk columns per region file along x and z
+	const int REGION_SIZE = 32;
+
+	//REGION_SIZE x REGION_SIZE columns of chunks in one file: a header, one table entry per chunk and
+	//one for the pending record, then the records, each on a run of sectors that a record which grows
+	//leaves for the next one; a chunk is the run length encoded block types in linear xzy order, lz
+	//compressed; the file is read through mmap and written with pwrite
+	class RegionFile
+	{
+		public:
+			RegionFile();
+			~RegionFile();
+
+			//creates the file if it is missing or empty; one from another seed, chunk size or version is left
+			//alone and not opened, as it may be the only copy of another world
+			bool open(const string &path, unsigned int seed, unsigned int chunkSizeX, unsigned int chunkSizeY, unsigned int chunkSizeZ, unsigned int height);
+			void close();
+
+			//x, z inside of the region, y the chunk in the column; types as in Chunk::getAll
+			bool read(int x, int y, int z, unsigned char *types);
+			bool write(int x, int y, int z, const unsigned char *types);
+			//what World keeps for the chunks of the region that are not generated yet, as it encodes it
+			bool readPending(vector<unsigned char> &data);
+			bool writePending(const vector<unsigned char> &data);
+
+			unsigned int getStoredBytes(); //of all chunks, without the sector padding
+
+		private:
+			struct header_t
+			{
+				char magic[4];
+				uint32_t version;
+				uint32_t seed;
+				uint32_t chunkSize[3];
+				uint32_t height; //chunks per column
+				uint32_t unused;
+			};
+			struct entry_t
+			{
+				uint32_t offset, size; //in bytes, 0 if the chunk is not stored
+			};
+
+			bool map(); //maps the whole file, again after it grew
+			unsigned int entryIndex(int x, int y, int z);
+			bool writeRecord(unsigned int index, const void *head, unsigned int headSize, const void *body, unsigned int bodySize);
+			void markSectors(unsigned int offset, unsigned int size, bool used);
+			unsigned int allocateSectors(unsigned int count); //first fit, else at the end of the file, returns the offset
+
+			int file;
+			unsigned char *mapped;
+			unsigned int mappedSize, fileSize;
+			header_t header;
+			vector<entry_t> table;
+			vector<bool> sectors; //whether the header, the table or a chunk is on sector i
+			unsigned int chunkBytes;
+			vector<unsigned char> rle, lz; //scratch
+	};
+}
+
+#endif
@@ -1,4 +1,10 @@
 #include "aabb.hpp"
+#include <cstring>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 motor::AABB::AABB()
 {
@@ -29,3 +35,43 @@ glm::vec3 motor::AABB::center()
 {
 	return min + glm::vec3((max.x - min.x) / 2, (max.y - min.y) / 2, (max.z - min.z) / 2);
 }
+
+void motor::AABB::cullFrustum(const float *const bounds[6], unsigned int count, const glm::vec4 planes[6], unsigned char *visible)
+{
+	memset(visible, 1, count);
+	for(unsigned int p = 0; p < 6; p++)
+	{
+		//the corner furthest along the normal is outside only if the whole box is,
+		//which corner that is only depends on the plane, so it is the same for every box
+		const glm::vec4 &plane = planes[p];
+		const float *x = plane.x > 0 ? bounds[3] : bounds[0];
+		const float *y = plane.y > 0 ? bounds[4] : bounds[1];
+		const float *z = plane.z > 0 ? bounds[5] : bounds[2];
+
+		unsigned int i = 0;
+#if defined(__AVX__)
+		__m256 a8 = _mm256_set1_ps(plane.x), b8 = _mm256_set1_ps(plane.y), c8 = _mm256_set1_ps(plane.z), d8 = _mm256_set1_ps(plane.w);
+		for(; i + 8 <= count; i += 8)
+		{
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a8, _mm256_loadu_ps(x + i)), _mm256_mul_ps(b8, _mm256_loadu_ps(y + i))),
+					_mm256_add_ps(_mm256_mul_ps(c8, _mm256_loadu_ps(z + i)), d8));
+			int outside = _mm256_movemask_ps(_mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_LT_OQ));
+			for(; outside; outside &= outside - 1)
+				visible[i + __builtin_ctz(outside)] = 0;
+		}
+#elif defined(__SSE2__)
+		__m128 a4 = _mm_set1_ps(plane.x), b4 = _mm_set1_ps(plane.y), c4 = _mm_set1_ps(plane.z), d4 = _mm_set1_ps(plane.w);
+		for(; i + 4 <= count; i += 4)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a4, _mm_loadu_ps(x + i)), _mm_mul_ps(b4, _mm_loadu_ps(y + i))),
+					_mm_add_ps(_mm_mul_ps(c4, _mm_loadu_ps(z + i)), d4));
+			int outside = _mm_movemask_ps(_mm_cmplt_ps(distance, _mm_setzero_ps()));
+			for(; outside; outside &= outside - 1)
+				visible[i + __builtin_ctz(outside)] = 0;
+		}
+#endif
+		for(; i < count; i++)
+			if((plane.x * x[i] + plane.y * y[i]) + (plane.z * z[i] + plane.w) < 0)
+				visible[i] = 0;
+	}
+}
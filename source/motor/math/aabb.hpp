@@ -1,3 +1,6 @@
+#ifndef _AABB_HPP
+#define _AABB_HPP
+
 #include <motor/math/glm/glm.hpp>
 #include <cmath>
 using namespace std;
@@ -17,6 +20,10 @@ namespace motor
 			static bool isVecInside(AABB& aabb, glm::vec3& v);
 			glm::vec3 center();
 
+			//clears visible[i] for every box that is completely outside one of the planes (xyz normal
+			//pointing inside, w distance), boxes are given as arrays of min x, y, z and max x, y, z
+			static void cullFrustum(const float *const bounds[6], unsigned int count, const glm::vec4 planes[6], unsigned char *visible);
+
 			glm::vec3 min;
 			glm::vec3 max;
 	};
@@ -36,3 +43,4 @@ namespace motor
  *  |
  *  min
  */
+#endif
@@ -0,0 +1,131 @@
+#include "gradientNoise.hpp"
+#include "motor/math/random.hpp"
+#include "motor/math/integer.hpp"
+
+#include <cmath>
+
+motor::GradientNoise::GradientNoise()
+{
+	set(0, 0, 0, 0, 0);
+}
+
+motor::GradientNoise::GradientNoise(double persistence, double frequency, double amplitude, int octaves, int seed)
+{
+	set(persistence, frequency, amplitude, octaves, seed);
+}
+
+void motor::GradientNoise::set(double persistence, double frequency, double amplitude, int octaves, int seed)
+{
+	m_persistence = persistence;
+	m_frequency = frequency;
+	m_amplitude = amplitude;
+	m_octaves = octaves;
+
+	//fisher yates shuffle
+	Random random(uint32_t(seed), 0);
+	for(unsigned int i = 0; i < 256; i++)
+		perm[i] = i;
+	for(unsigned int i = 255; i > 0; i--)
+	{
+		unsigned int j = random.nextBelow(i + 1);
+		unsigned char swap = perm[i];
+		perm[i] = perm[j];
+		perm[j] = swap;
+	}
+	for(unsigned int i = 0; i < 256; i++)
+		perm[256 + i] = perm[i];
+}
+
+double motor::GradientNoise::getValue(double x, double y, double z) const
+{
+	double t = 0.0;
+	double amplitude = 1;
+	double freq = m_frequency;
+	for(int k = 0; k < m_octaves; k++)
+	{
+		//an offset per octave, so the lattice points of the octaves do not line up at the origin
+		t += noise(x * freq + k * 31.7, y * freq + k * 17.3, z * freq + k * 23.9) * amplitude;
+		amplitude *= m_persistence;
+		freq *= 2;
+	}
+	return m_amplitude * t;
+}
+
+static inline double fade(double t)
+{
+	return t * t * t * (t * (t * 6.0 - 15.0) + 10.0);
+}
+
+static inline double lerp(double a, double b, double t)
+{
+	return a + t * (b - a);
+}
+
+//dot product of the offset with one of the 12 edge directions of a cube, picked by the low 4 bits of hash
+static inline double gradient(int hash, double x, double y, double z)
+{
+	int h = hash & 15;
+	double u = h < 8 ? x : y;
+	double v = h < 4 ? y : (h == 12 || h == 14 ? x : z);
+	return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+}
+
+double motor::GradientNoise::noise(double x, double y, double z) const
+{
+	double xFloor = floor(x), yFloor = floor(y), zFloor = floor(z);
+	int X = int(xFloor) & 255, Y = int(yFloor) & 255, Z = int(zFloor) & 255;
+	x -= xFloor;
+	y -= yFloor;
+	z -= zFloor;
+	double u = fade(x), v = fade(y), w = fade(z);
+
+	//hashes of the 8 corners of the cell
+	int A = perm[X] + Y, AA = perm[A] + Z, AB = perm[A + 1] + Z;
+	int B = perm[X + 1] + Y, BA = perm[B] + Z, BB = perm[B + 1] + Z;
+
+	return lerp(lerp(lerp(gradient(perm[AA], x, y, z), gradient(perm[BA], x - 1, y, z), u),
+	                 lerp(gradient(perm[AB], x, y - 1, z), gradient(perm[BB], x - 1, y - 1, z), u), v),
+	            lerp(lerp(gradient(perm[AA + 1], x, y, z - 1), gradient(perm[BA + 1], x - 1, y, z - 1), u),
+	                 lerp(gradient(perm[AB + 1], x, y - 1, z - 1), gradient(perm[BB + 1], x - 1, y - 1, z - 1), u), v), w);
+}
+
+void motor::GradientNoise::getDensities(int x0, int y0, int z0, unsigned int sizeX, unsigned int sizeY, unsigned int sizeZ, unsigned int step, float *density, vector<float> &coarse) const
+{
+	//the lattice points around the blocks, one past the last one so every block has an upper neighbor
+	int s = step;
+	int cx0 = floorDiv(x0, s), cy0 = floorDiv(y0, s), cz0 = floorDiv(z0, s);
+	unsigned int cx = floorDiv(x0 + int(sizeX) - 1, s) - cx0 + 2;
+	unsigned int cy = floorDiv(y0 + int(sizeY) - 1, s) - cy0 + 2;
+	unsigned int cz = floorDiv(z0 + int(sizeZ) - 1, s) - cz0 + 2;
+	coarse.resize(cx * cy * cz);
+	for(unsigned int i = 0; i < cx; i++)
+		for(unsigned int k = 0; k < cz; k++)
+			for(unsigned int j = 0; j < cy; j++)
+				coarse[(i * cz + k) * cy + j] = getValue((cx0 + int(i)) * s, (cy0 + int(j)) * s, (cz0 + int(k)) * s);
+
+	//along y innermost, the lattice column and the weights of the x and z axis stay the same
+	float inverse = 1.f / float(s);
+	for(unsigned int x = 0; x < sizeX; x++)
+	{
+		int xBlock = x0 + int(x), xCell = floorDiv(xBlock, s);
+		float fx = float(xBlock - xCell * s) * inverse;
+		for(unsigned int z = 0; z < sizeZ; z++)
+		{
+			int zBlock = z0 + int(z), zCell = floorDiv(zBlock, s);
+			float fz = float(zBlock - zCell * s) * inverse;
+			const float *c00 = &coarse[((xCell - cx0) * cz + (zCell - cz0)) * cy];
+			const float *c10 = c00 + cz * cy; //x + 1
+			const float *c01 = c00 + cy; //z + 1
+			const float *c11 = c10 + cy;
+			float *column = density + (x * sizeZ + z) * sizeY;
+			for(unsigned int y = 0; y < sizeY; y++)
+			{
+				int yBlock = y0 + int(y), yCell = floorDiv(yBlock, s) - cy0;
+				float fy = float(yBlock - (yCell + cy0) * s) * inverse;
+				float low = (c00[yCell] * (1 - fx) + c10[yCell] * fx) * (1 - fz) + (c01[yCell] * (1 - fx) + c11[yCell] * fx) * fz;
+				float high = (c00[yCell + 1] * (1 - fx) + c10[yCell + 1] * fx) * (1 - fz) + (c01[yCell + 1] * (1 - fx) + c11[yCell + 1] * fx) * fz;
+				column[y] = low + (high - low) * fy;
+			}
+		}
+	}
+}
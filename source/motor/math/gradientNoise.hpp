@@ -0,0 +1,36 @@
+#ifndef _GRADIENTNOISE_HPP
+#define _GRADIENTNOISE_HPP
+
+#include <vector>
+using namespace std;
+
+namespace motor
+{
+	//3d gradient noise in the improved perlin layout: a gradient on every lattice point picked
+	//through a permutation table shuffled by the seed, quintic fade between them
+	class GradientNoise
+	{
+		public:
+			GradientNoise();
+			GradientNoise(double persistence, double frequency, double amplitude, int octaves, int seed);
+
+			void set(double persistence, double frequency, double amplitude, int octaves, int seed);
+
+			//about -amplitude to amplitude, 0 on every lattice point of the first octave
+			double getValue(double x, double y, double z) const;
+
+			//getValue on the blocks from x0, y0, z0 on, density[(x * sizeZ + z) * sizeY + y]; sampled every step
+			//blocks and trilinearly interpolated in between, on a lattice aligned to multiples of step, so
+			//neighboring areas agree on their border; coarse is scratch
+			void getDensities(int x0, int y0, int z0, unsigned int sizeX, unsigned int sizeY, unsigned int sizeZ, unsigned int step, float *density, vector<float> &coarse) const;
+
+		private:
+			double noise(double x, double y, double z) const;
+
+			double m_persistence, m_frequency, m_amplitude;
+			int m_octaves;
+			unsigned char perm[512]; //two copies of a permutation of 0 to 255, so perm[perm[x] + y] needs no wrap
+	};
+}
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef _INTEGER_HPP
+#define _INTEGER_HPP
+
+namespace motor
+{
+	//rounds towards negative infinity, so block -1 is in chunk -1
+	inline int floorDiv(int a, int b)
+	{
+		return a >= 0 ? a / b : -((-a - 1) / b) - 1;
+	}
+}
+
+#endif
@@ -1,4 +1,14 @@
 #include "perlinNoise.hpp"
+#include "motor/math/random.hpp"
+
+#include <algorithm>
+#include <cmath>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+using namespace std;
 
 motor::PerlinNoise::PerlinNoise()
 {
@@ -11,11 +21,7 @@ motor::PerlinNoise::PerlinNoise()
 
 motor::PerlinNoise::PerlinNoise(double _persistence, double _frequency, double _amplitude, int _octaves, int _randomseed)
 {
-	m_persistence = _persistence;
-	m_frequency = _frequency;
-	m_amplitude  = _amplitude;
-	m_octaves = _octaves;
-	m_randomseed = 2 + _randomseed * _randomseed;
+	set(_persistence, _frequency, _amplitude, _octaves, _randomseed);
 }
 
 void motor::PerlinNoise::set(double _persistence, double _frequency, double _amplitude, int _octaves, int _randomseed)
@@ -24,7 +30,9 @@ void motor::PerlinNoise::set(double _persistence, double _frequency, double _amp
 	m_frequency = _frequency;
 	m_amplitude  = _amplitude;
 	m_octaves = _octaves;
-	m_randomseed = 2 + _randomseed * _randomseed;
+	//the seed picks an offset into the lattice; 2 + seed * seed overflowed and gave
+	//seed and -seed, and nearby seeds in large areas, the same terrain
+	m_randomseed = int(randomMix(uint32_t(_randomseed)) & 0xFFFFF);
 }
 
 double motor::PerlinNoise::getHeight(double x, double y) const
@@ -51,8 +59,9 @@ double motor::PerlinNoise::total(double i, double j) const
 
 double motor::PerlinNoise::getValue(double x, double y) const
 {
-	int Xint = (int)x;
-	int Yint = (int)y;
+	//floor, not truncation, so the lattice continues past 0 into negative coordinates
+	int Xint = (int)floor(x);
+	int Yint = (int)floor(y);
 	double Xfrac = x - Xint;
 	double Yfrac = y - Yint;
 
@@ -102,8 +111,206 @@ double motor::PerlinNoise::interpolate(double x, double y, double a) const
 
 double motor::PerlinNoise::noise(int x, int y) const
 {
-	int n = x + y * 57;
+	//unsigned, signed overflow is undefined; the same bits as the int version
+	unsigned int n = unsigned(x) + unsigned(y) * 57u;
 	n = (n << 13) ^ n;
-	int t = (n * (n * n * 15731 + 789221) + 1376312589) & 0x7fffffff;
+	unsigned int t = (n * (n * n * 15731u + 789221u) + 1376312589u) & 0x7fffffff;
 	return 1.0 - double(t) * 0.931322574615478515625e-9;/// 1073741824.0);
 }
+
+#if defined(__AVX2__) || defined(__SSE2__)
+//four doubles, in one avx register or in two sse2 ones, and their lattice coordinates as four ints
+#if defined(__AVX2__)
+typedef __m256d double4_t;
+static inline double4_t set4(double v) { return _mm256_set1_pd(v); }
+static inline double4_t load4(const double *v) { return _mm256_loadu_pd(v); }
+static inline void store4(double *to, double4_t v) { _mm256_storeu_pd(to, v); }
+static inline double4_t add4(double4_t a, double4_t b) { return _mm256_add_pd(a, b); }
+static inline double4_t sub4(double4_t a, double4_t b) { return _mm256_sub_pd(a, b); }
+static inline double4_t mul4(double4_t a, double4_t b) { return _mm256_mul_pd(a, b); }
+static inline double4_t floor4(double4_t v) { return _mm256_floor_pd(v); }
+static inline __m128i toInt4(double4_t v) { return _mm256_cvttpd_epi32(v); }
+static inline double4_t toDouble4(__m128i v) { return _mm256_cvtepi32_pd(v); }
+static inline __m128i mullo4(__m128i a, __m128i b) { return _mm_mullo_epi32(a, b); }
+#else
+typedef struct double4_t { __m128d lo, hi; } double4_t;
+static inline double4_t make4(__m128d lo, __m128d hi) { double4_t v = {lo, hi}; return v; }
+static inline double4_t set4(double v) { return make4(_mm_set1_pd(v), _mm_set1_pd(v)); }
+static inline double4_t load4(const double *v) { return make4(_mm_loadu_pd(v), _mm_loadu_pd(v + 2)); }
+static inline void store4(double *to, double4_t v) { _mm_storeu_pd(to, v.lo); _mm_storeu_pd(to + 2, v.hi); }
+static inline double4_t add4(double4_t a, double4_t b) { return make4(_mm_add_pd(a.lo, b.lo), _mm_add_pd(a.hi, b.hi)); }
+static inline double4_t sub4(double4_t a, double4_t b) { return make4(_mm_sub_pd(a.lo, b.lo), _mm_sub_pd(a.hi, b.hi)); }
+static inline double4_t mul4(double4_t a, double4_t b) { return make4(_mm_mul_pd(a.lo, b.lo), _mm_mul_pd(a.hi, b.hi)); }
+static inline __m128i toInt4(double4_t v) { return _mm_unpacklo_epi64(_mm_cvttpd_epi32(v.lo), _mm_cvttpd_epi32(v.hi)); }
+static inline double4_t toDouble4(__m128i v) { return make4(_mm_cvtepi32_pd(v), _mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)))); }
+//sse2 has no floor, truncation is one too large for negative numbers with a fraction
+static inline double4_t floor4(double4_t v)
+{
+	double4_t t = toDouble4(toInt4(v));
+	__m128d one = _mm_set1_pd(1.0);
+	return make4(_mm_sub_pd(t.lo, _mm_and_pd(_mm_cmpgt_pd(t.lo, v.lo), one)), _mm_sub_pd(t.hi, _mm_and_pd(_mm_cmpgt_pd(t.hi, v.hi), one)));
+}
+//nor a 32 bit multiplication, from the two 64 bit products of the even and of the odd lanes
+static inline __m128i mullo4(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+#endif
+
+//noise() of four lattice points in a row, row is y * 57
+static inline double4_t noise4(__m128i x, int row)
+{
+	__m128i n = _mm_add_epi32(x, _mm_set1_epi32(row));
+	n = _mm_xor_si128(_mm_slli_epi32(n, 13), n);
+	__m128i t = _mm_add_epi32(mullo4(mullo4(n, n), _mm_set1_epi32(15731)), _mm_set1_epi32(789221));
+	t = _mm_add_epi32(mullo4(n, t), _mm_set1_epi32(1376312589));
+	t = _mm_and_si128(t, _mm_set1_epi32(0x7fffffff));
+	return sub4(set4(1.0), mul4(toDouble4(t), set4(0.931322574615478515625e-9)));
+}
+
+static inline double4_t interpolate4(double4_t x, double4_t y, double4_t a)
+{
+	double4_t negA = sub4(set4(1.0), a);
+	double4_t negASqr = mul4(negA, negA);
+	double4_t fac1 = sub4(mul4(set4(3.0), negASqr), mul4(set4(2.0), mul4(negASqr, negA)));
+	double4_t aSqr = mul4(a, a);
+	double4_t fac2 = sub4(mul4(set4(3.0), aSqr), mul4(set4(2.0), mul4(aSqr, a)));
+	return add4(mul4(x, fac1), mul4(y, fac2));
+}
+
+//one corner of getValue: its 4 diagonal, 4 direct neighbors and itself
+static inline double4_t corner4(double4_t d0, double4_t d1, double4_t d2, double4_t d3, double4_t n0, double4_t n1, double4_t n2, double4_t n3, double4_t center)
+{
+	double4_t diagonal = add4(add4(add4(d0, d1), d2), d3);
+	double4_t direct = add4(add4(add4(n0, n1), n2), n3);
+	return add4(add4(mul4(set4(0.0625), diagonal), mul4(set4(0.125), direct)), mul4(set4(0.25), center));
+}
+
+//getValue(x[l], y) for four x, the same steps on each lane
+static inline double4_t getValues4(double4_t x, double y)
+{
+	__m128i xInt = toInt4(floor4(x));
+	double4_t xFrac = sub4(x, toDouble4(xInt));
+	int yInt = (int)floor(y);
+	double yFrac = y - yInt;
+
+	//n[1 + dy][1 + dx] = noise(xInt + dx, yInt + dy)
+	double4_t n[4][4];
+	for(int dy = 0; dy < 4; dy++)
+	{
+		int row = int(unsigned(yInt + dy - 1) * 57u);
+		for(int dx = 0; dx < 4; dx++)
+			n[dy][dx] = noise4(_mm_add_epi32(xInt, _mm_set1_epi32(dx - 1)), row);
+	}
+
+	double4_t x0y0 = corner4(n[0][0], n[0][2], n[2][0], n[2][2], n[1][0], n[1][2], n[0][1], n[2][1], n[1][1]);
+	double4_t x1y0 = corner4(n[0][1], n[0][3], n[2][1], n[2][3], n[1][1], n[1][3], n[0][2], n[2][2], n[1][2]);
+	double4_t x0y1 = corner4(n[1][0], n[1][2], n[3][0], n[3][2], n[2][0], n[2][2], n[1][1], n[3][1], n[2][1]);
+	double4_t x1y1 = corner4(n[1][1], n[1][3], n[3][1], n[3][3], n[2][1], n[2][3], n[1][2], n[3][2], n[2][2]);
+	double4_t v1 = interpolate4(x0y0, x1y0, xFrac);
+	double4_t v2 = interpolate4(x0y1, x1y1, xFrac);
+	return interpolate4(v1, v2, set4(yFrac));
+}
+#endif
+
+void motor::PerlinNoise::getHeights(double x0, double y0, unsigned int w, unsigned int h, double *heights, perlinScratch_t *scratch) const
+{
+	perlinScratch_t local;
+	if(scratch == NULL)
+		scratch = &local;
+
+	//octave by octave, every sample adds them up in the order total() does
+	for(unsigned int i = 0; i < w * h; i++)
+		heights[i] = 0.0;
+	double amplitude = 1;
+	double freq = m_frequency;
+	for(int k = 0; k < m_octaves; k++)
+	{
+		addOctave(x0, y0, w, h, freq, amplitude, heights, *scratch);
+		amplitude *= m_persistence;
+		freq *= 2;
+	}
+	for(unsigned int i = 0; i < w * h; i++)
+		heights[i] = m_amplitude * heights[i];
+}
+
+void motor::PerlinNoise::addOctave(double x0, double y0, unsigned int w, unsigned int h, double freq, double amplitude, double *heights, perlinScratch_t &scratch) const
+{
+	if(w == 0 || h == 0)
+		return;
+
+	//the lattice cells the samples fall into, getValue swaps the axes
+	int a = (int)floor(y0 * freq + m_randomseed), b = (int)floor((y0 + (h - 1)) * freq + m_randomseed);
+	int xLow = min(a, b), xHigh = max(a, b);
+	a = (int)floor(x0 * freq + m_randomseed);
+	b = (int)floor((x0 + (w - 1)) * freq + m_randomseed);
+	int yLow = min(a, b), yHigh = max(a, b);
+
+	//once a sample needs more than a few lattice points of its own, hashing it directly is cheaper
+	double latticeArea = double(xHigh - xLow + 4) * double(yHigh - yLow + 4);
+	if(latticeArea > 8.0 * w * h)
+	{
+		for(unsigned int i = 0; i < w; i++)
+		{
+			double *row = heights + i * h;
+			double valueY = (x0 + i) * freq + m_randomseed;
+			unsigned int k = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+			for(; k + 4 <= h; k += 4)
+			{
+				double y[4] = {y0 + k, y0 + (k + 1), y0 + (k + 2), y0 + (k + 3)};
+				double4_t valueX = add4(mul4(load4(y), set4(freq)), set4(m_randomseed));
+				store4(row + k, add4(load4(row + k), mul4(getValues4(valueX, valueY), set4(amplitude))));
+			}
+#endif
+			for(; k < h; k++)
+				row[k] += getValue((y0 + k) * freq + m_randomseed, valueY) * amplitude;
+		}
+		return;
+	}
+
+	//noise of every lattice point the smoothing reaches, then the smoothed values the samples interpolate
+	unsigned int noiseX = xHigh - xLow + 4, noiseY = yHigh - yLow + 4;
+	scratch.lattice.resize(noiseX * noiseY);
+	for(unsigned int y = 0; y < noiseY; y++)
+		for(unsigned int x = 0; x < noiseX; x++)
+			scratch.lattice[y * noiseX + x] = noise(xLow - 1 + int(x), yLow - 1 + int(y));
+
+	unsigned int smoothX = noiseX - 2, smoothY = noiseY - 2;
+	scratch.smoothed.resize(smoothX * smoothY);
+	for(unsigned int y = 0; y < smoothY; y++)
+		for(unsigned int x = 0; x < smoothX; x++)
+		{
+			//the same sums in the same order as the corners of getValue
+			const double *n = &scratch.lattice[(y + 1) * noiseX + x + 1];
+			double diagonal = n[-int(noiseX) - 1] + n[-int(noiseX) + 1] + n[noiseX - 1] + n[noiseX + 1];
+			double direct = n[-1] + n[1] + n[-int(noiseX)] + n[noiseX];
+			scratch.smoothed[y * smoothX + x] = 0.0625*diagonal + 0.125*direct + 0.25*n[0];
+		}
+
+	scratch.xInt.resize(h);
+	scratch.xFrac.resize(h);
+	for(unsigned int k = 0; k < h; k++)
+	{
+		double x = (y0 + k) * freq + m_randomseed;
+		scratch.xInt[k] = (int)floor(x);
+		scratch.xFrac[k] = x - scratch.xInt[k];
+	}
+	for(unsigned int i = 0; i < w; i++)
+	{
+		double y = (x0 + i) * freq + m_randomseed;
+		int yInt = (int)floor(y);
+		double yFrac = y - yInt;
+		const double *smoothed = &scratch.smoothed[(yInt - yLow) * smoothX];
+		double *row = heights + i * h;
+		for(unsigned int k = 0; k < h; k++)
+		{
+			const double *corner = smoothed + scratch.xInt[k] - xLow;
+			double v1 = interpolate(corner[0], corner[1], scratch.xFrac[k]);
+			double v2 = interpolate(corner[smoothX], corner[smoothX + 1], scratch.xFrac[k]);
+			row[k] += interpolate(v1, v2, yFrac) * amplitude;
+		}
+	}
+}
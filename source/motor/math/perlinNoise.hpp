@@ -1,8 +1,20 @@
 #ifndef _PERLIN_HPP
 #define _PERLIN_HPP
 
+#include <cstddef>
+#include <vector>
+
 namespace motor
 {
+	//working memory of PerlinNoise::getHeights, one per thread that evaluates at the same time
+	typedef struct perlinScratch_t
+	{
+		std::vector<double> lattice; //noise of the lattice points of one octave
+		std::vector<double> smoothed; //their weighted neighborhoods, the values getValue interpolates
+		std::vector<int> xInt;
+		std::vector<double> xFrac;
+	} perlinScratch_t;
+
 	class PerlinNoise
 	{
 		public:
@@ -13,6 +25,10 @@ namespace motor
 
 			// Get Height
 			double getHeight(double x, double y) const;
+			//heights[i * h + k] = getHeight(x0 + i, y0 + k), bit for bit; low octaves interpolate the lattice
+			//they share once, high ones take four samples at once with SSE2 or AVX2, in the same order of
+			//operations, so the compiler must not contract them to fma
+			void getHeights(double x0, double y0, unsigned int w, unsigned int h, double *heights, perlinScratch_t *scratch = NULL) const;
 
 			// Get
 			double persistence() const { return m_persistence; }
@@ -33,6 +49,8 @@ namespace motor
 		private:
 
 			double total(double i, double j) const;
+			//heights += amplitude * getValue of every sample of getHeights at this frequency
+			void addOctave(double x0, double y0, unsigned int w, unsigned int h, double freq, double amplitude, double *heights, perlinScratch_t &scratch) const;
 			double getValue(double x, double y) const;
 			double interpolate(double x, double y, double a) const;
 			double noise(int x, int y) const;
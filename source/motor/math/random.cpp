@@ -0,0 +1,16 @@
+#include "random.hpp"
+
+motor::Random::Random(uint64_t seed, unsigned int stream)
+{
+	key = randomMix(randomMix(seed) ^ stream);
+	counter = 0;
+}
+
+motor::Random::Random(uint64_t seed, int x, int y, int z, unsigned int stream)
+{
+	//a mixing round for every 64 bits of input
+	key = randomMix(seed);
+	key = randomMix(key ^ (uint64_t(uint32_t(x)) | (uint64_t(uint32_t(z)) << 32)));
+	key = randomMix(key ^ (uint64_t(uint32_t(y)) | (uint64_t(stream) << 32)));
+	counter = 0;
+}
@@ -0,0 +1,69 @@
+#ifndef _RANDOM_HPP
+#define _RANDOM_HPP
+
+#include <stdint.h>
+
+namespace motor
+{
+	//independent uses of one seed draw from their own stream, so they do not get the same numbers
+	enum randomStreamEnum
+	{
+		RANDOM_STREAM_WORLD = 0, //the seed of the next world
+		RANDOM_STREAM_BASE,
+		RANDOM_STREAM_MOUNTAINS,
+		RANDOM_STREAM_SAND,
+		RANDOM_STREAM_CAVES,
+		RANDOM_STREAM_FEATURES
+	};
+
+	//the splitmix64 finalizer, a bijection that spreads every input bit over all output bits
+	inline uint64_t randomMix(uint64_t x)
+	{
+		x ^= x >> 30;
+		x *= 0xBF58476D1CE4E5B9ull;
+		x ^= x >> 27;
+		x *= 0x94D049BB133111EBull;
+		x ^= x >> 31;
+		return x;
+	}
+
+	//counter based random numbers: the n-th number is a hash of the key and n, nothing is carried from
+	//one number to the next, so a chunk draws the same numbers on any thread, in any order, on its own
+	class Random
+	{
+		public:
+			Random(uint64_t seed, unsigned int stream);
+			Random(uint64_t seed, int x, int y, int z, unsigned int stream); //of the chunk at x, y, z
+
+			uint64_t at(uint64_t n) const;
+			uint32_t next(); //the number at the counter, which moves on
+			unsigned int nextBelow(unsigned int n); //0 to n - 1
+			double nextDouble(); //0 to 1, without 1
+
+		private:
+			uint64_t key, counter;
+	};
+
+	inline uint64_t Random::at(uint64_t n) const
+	{
+		//splitmix64 steps through the counter with the golden ratio
+		return randomMix(key + (n + 1) * 0x9E3779B97F4A7C15ull);
+	}
+
+	inline uint32_t Random::next()
+	{
+		return at(counter++) >> 32;
+	}
+
+	inline unsigned int Random::nextBelow(unsigned int n)
+	{
+		return (uint64_t(next()) * n) >> 32;
+	}
+
+	inline double Random::nextDouble()
+	{
+		return double(at(counter++) >> 11) * (1.0 / 9007199254740992.0);
+	}
+}
+
+#endif
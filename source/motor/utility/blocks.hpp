@@ -35,6 +35,7 @@ namespace motor
 	 */
 	const double TILESET_DISPLACEMENT = 16.0 / double(TILESET_WIDTH);
 	const double OFFSET = 0.0001;
+	const double TILE_SIZE = TILESET_DISPLACEMENT - 2 * OFFSET; //size of one tile in the shader, see data/base.frag
 
 	const glm::vec2 blockTexCoord[] =
 	{
@@ -56,6 +57,16 @@ namespace motor
 		glm::vec2(TILESET_DISPLACEMENT * 3 - OFFSET, 0.0f),
 		glm::vec2(TILESET_DISPLACEMENT * 2 + OFFSET, 0.0f)
 	};
+
+	//corners of a block face in tile space, the shader wraps them into the tile that
+	//starts at the UPPERLEFT blockTexCoord, a face merged over w * h blocks uses corner * (w, h)
+	const glm::vec2 tileCorner[] =
+	{
+		glm::vec2(0.0f, 1.0f),
+		glm::vec2(1.0f, 1.0f),
+		glm::vec2(1.0f, 0.0f),
+		glm::vec2(0.0f, 0.0f)
+	};
 }
 #endif
 
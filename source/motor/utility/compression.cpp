@@ -0,0 +1,169 @@
+#include "compression.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+
+void motor::rleEncode(const unsigned char *data, unsigned int size, vector<unsigned char> &out)
+{
+	out.clear();
+	for(unsigned int i = 0; i < size; )
+	{
+		unsigned int run = 1;
+		while(i + run < size && data[i + run] == data[i])
+			run++;
+		out.push_back(data[i]);
+		for(unsigned int length = run; ; length >>= 7)
+		{
+			if(length < 0x80)
+			{
+				out.push_back(length);
+				break;
+			}
+			out.push_back((length & 0x7F) | 0x80);
+		}
+		i += run;
+	}
+}
+
+bool motor::rleDecode(const unsigned char *data, unsigned int size, unsigned char *out, unsigned int outSize)
+{
+	unsigned int in = 0, written = 0;
+	while(in < size)
+	{
+		unsigned char value = data[in++];
+		unsigned int run = 0;
+		for(unsigned int shift = 0; ; shift += 7)
+		{
+			if(in >= size || shift > 28)
+				return false;
+			unsigned char byte = data[in++];
+			run |= (byte & 0x7F) << shift;
+			if(!(byte & 0x80))
+				break;
+		}
+		if(run > outSize - written)
+			return false;
+		memset(out + written, value, run);
+		written += run;
+	}
+	return written == outSize;
+}
+
+static const unsigned int LZ_MIN_MATCH = 4;
+static const unsigned int LZ_HASH_BITS = 12;
+
+static inline uint32_t read32(const unsigned char *p)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static inline void writeLength(vector<unsigned char> &out, unsigned int length)
+{
+	for(; length >= 255; length -= 255)
+		out.push_back(255);
+	out.push_back(length);
+}
+
+void motor::lzCompress(const unsigned char *data, unsigned int size, vector<unsigned char> &out)
+{
+	out.clear();
+	out.reserve(size / 2 + 16);
+
+	//last position of every hashed 4 byte sequence, only a hint, the bytes are compared
+	int table[1 << LZ_HASH_BITS];
+	for(unsigned int h = 0; h < (1u << LZ_HASH_BITS); h++)
+		table[h] = -1;
+
+	unsigned int anchor = 0, i = 0;
+	while(i + LZ_MIN_MATCH <= size)
+	{
+		uint32_t sequence = read32(data + i);
+		unsigned int h = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+		int candidate = table[h];
+		table[h] = i;
+		if(candidate < 0 || i - candidate > 0xFFFF || read32(data + candidate) != sequence)
+		{
+			i++;
+			continue;
+		}
+
+		unsigned int match = LZ_MIN_MATCH;
+		while(i + match < size && data[candidate + match] == data[i + match])
+			match++;
+
+		unsigned int literals = i - anchor;
+		unsigned int matchCode = match - LZ_MIN_MATCH;
+		out.push_back((min(literals, 15u) << 4) | min(matchCode, 15u));
+		if(literals >= 15)
+			writeLength(out, literals - 15);
+		out.insert(out.end(), data + anchor, data + i);
+		unsigned int offset = i - candidate;
+		out.push_back(offset & 0xFF);
+		out.push_back(offset >> 8);
+		if(matchCode >= 15)
+			writeLength(out, matchCode - 15);
+
+		i += match;
+		anchor = i;
+	}
+
+	unsigned int literals = size - anchor;
+	out.push_back(min(literals, 15u) << 4);
+	if(literals >= 15)
+		writeLength(out, literals - 15);
+	out.insert(out.end(), data + anchor, data + size);
+}
+
+//length continuation bytes after a nibble of 15, false if the input ends first
+static inline bool readLength(const unsigned char *data, unsigned int size, unsigned int &in, unsigned int &length)
+{
+	unsigned char byte;
+	do
+	{
+		if(in >= size)
+			return false;
+		byte = data[in++];
+		length += byte;
+	} while(byte == 255);
+	return true;
+}
+
+bool motor::lzDecompress(const unsigned char *data, unsigned int size, unsigned char *out, unsigned int outSize)
+{
+	unsigned int in = 0, written = 0;
+	while(in < size)
+	{
+		unsigned char token = data[in++];
+		unsigned int literals = token >> 4;
+		if(literals == 15 && !readLength(data, size, in, literals))
+			return false;
+		if(literals > size - in || literals > outSize - written)
+			return false;
+		memcpy(out + written, data + in, literals);
+		in += literals;
+		written += literals;
+		if(in == size)
+			break; //the last sequence has no match
+
+		if(size - in < 2)
+			return false;
+		unsigned int offset = data[in] | (data[in + 1] << 8);
+		in += 2;
+		unsigned int match = token & 0x0F;
+		if(match == 15 && !readLength(data, size, in, match))
+			return false;
+		match += LZ_MIN_MATCH;
+		if(offset == 0 || offset > written || match > outSize - written)
+			return false;
+
+		//byte by byte, a match may overlap the bytes it produces
+		const unsigned char *from = out + written - offset;
+		for(unsigned int m = 0; m < match; m++)
+			out[written + m] = from[m];
+		written += match;
+	}
+	return written == outSize;
+}
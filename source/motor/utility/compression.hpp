@@ -0,0 +1,21 @@
+#ifndef _COMPRESSION_HPP
+#define _COMPRESSION_HPP
+
+#include <vector>
+using namespace std;
+
+namespace motor
+{
+	//runs of equal bytes as (value, run length) pairs, the length as a little endian base 128 varint
+	void rleEncode(const unsigned char *data, unsigned int size, vector<unsigned char> &out);
+	//false if the input is broken or does not decode to exactly outSize bytes
+	bool rleDecode(const unsigned char *data, unsigned int size, unsigned char *out, unsigned int outSize);
+
+	//lz77 with a 64 kB window in the lz4 block layout: a token with 4 bits of literal and of match
+	//length (both extended by bytes of 255 and a rest), the literals, a 2 byte offset and the match;
+	//the last sequence has literals only
+	void lzCompress(const unsigned char *data, unsigned int size, vector<unsigned char> &out);
+	bool lzDecompress(const unsigned char *data, unsigned int size, unsigned char *out, unsigned int outSize);
+}
+
+#endif
@@ -8,5 +8,7 @@ namespace motor
 		public:
 			bool printPosition;
 			bool holdPosition;
+			bool fixedSeed; //the world is generated from seed, given with -seed on the command line
+			int seed;
 	};
 }
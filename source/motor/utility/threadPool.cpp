@@ -0,0 +1,97 @@
+#include "threadPool.hpp"
+#include <unistd.h>
+
+motor::ThreadPool::ThreadPool(unsigned int threadCount)
+{
+	running = 0;
+	quit = false;
+	mutex = SDL_CreateMutex();
+	taskAdded = SDL_CreateCond();
+	taskDone = SDL_CreateCond();
+
+	if(threadCount == 0)
+		threadCount = getCpuCount();
+	for(unsigned int i = 0; i < threadCount; i++)
+		threads.push_back(SDL_CreateThread(worker, this));
+}
+
+motor::ThreadPool::~ThreadPool()
+{
+	SDL_LockMutex(mutex);
+	quit = true;
+	SDL_CondBroadcast(taskAdded);
+	SDL_UnlockMutex(mutex);
+
+	for(unsigned int i = 0; i < threads.size(); i++)
+		SDL_WaitThread(threads[i], NULL);
+
+	SDL_DestroyCond(taskDone);
+	SDL_DestroyCond(taskAdded);
+	SDL_DestroyMutex(mutex);
+}
+
+void motor::ThreadPool::add(job_t job, void *data)
+{
+	task_t task;
+	task.job = job;
+	task.data = data;
+
+	SDL_LockMutex(mutex);
+	tasks.push_back(task);
+	SDL_CondSignal(taskAdded);
+	SDL_UnlockMutex(mutex);
+}
+
+bool motor::ThreadPool::busy()
+{
+	SDL_LockMutex(mutex);
+	bool result = running > 0 || !tasks.empty();
+	SDL_UnlockMutex(mutex);
+	return result;
+}
+
+void motor::ThreadPool::wait()
+{
+	SDL_LockMutex(mutex);
+	while(running > 0 || !tasks.empty())
+		SDL_CondWait(taskDone, mutex);
+	SDL_UnlockMutex(mutex);
+}
+
+unsigned int motor::ThreadPool::getThreadCount()
+{
+	return threads.size();
+}
+
+unsigned int motor::ThreadPool::getCpuCount()
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return cpus > 0 ? cpus : 1;
+}
+
+int motor::ThreadPool::worker(void *data)
+{
+	ThreadPool *pool = (ThreadPool*)data;
+
+	SDL_LockMutex(pool->mutex);
+	while(true)
+	{
+		while(pool->tasks.empty() && !pool->quit)
+			SDL_CondWait(pool->taskAdded, pool->mutex);
+		if(pool->tasks.empty())
+			break;
+
+		task_t task = pool->tasks.front();
+		pool->tasks.pop_front();
+		pool->running++;
+		SDL_UnlockMutex(pool->mutex);
+
+		task.job(task.data);
+
+		SDL_LockMutex(pool->mutex);
+		pool->running--;
+		SDL_CondBroadcast(pool->taskDone);
+	}
+	SDL_UnlockMutex(pool->mutex);
+	return 0;
+}
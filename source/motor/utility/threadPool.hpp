@@ -0,0 +1,48 @@
+#ifndef _THREADPOOL_HPP
+#define _THREADPOOL_HPP
+
+#include <list>
+#include <vector>
+using namespace std;
+
+#include <SDL/SDL.h>
+#include <SDL/SDL_thread.h>
+
+namespace motor
+{
+	//fixed set of worker threads that run queued jobs in the order they were added
+	class ThreadPool
+	{
+		public:
+			typedef void (*job_t)(void *data);
+
+			ThreadPool(unsigned int threads = 0); //0 starts one thread per cpu
+			~ThreadPool();
+
+			void add(job_t job, void *data);
+			bool busy(); //jobs are queued or running
+			void wait(); //blocks until all jobs are done
+
+			unsigned int getThreadCount();
+			static unsigned int getCpuCount();
+
+		private:
+			struct task_t
+			{
+				job_t job;
+				void *data;
+			};
+
+			static int worker(void *pool);
+
+			vector<SDL_Thread*> threads;
+			list<task_t> tasks;
+			unsigned int running;
+			bool quit;
+
+			SDL_mutex *mutex;
+			SDL_cond *taskAdded;
+			SDL_cond *taskDone;
+	};
+}
+#endif
@@ -0,0 +1,163 @@
+//checks that features placed across chunk borders come out the same however the chunks were streamed:
+//the pending edits stay bounded while walking back and forth without a save directory, and a world
+//saved and continued with a larger radius or from a snapshot taken while streaming equals one that
+//never was; headless, nothing is meshed or drawn, exits with 1 if a check fails
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <ftw.h>
+using namespace std;
+
+#include "motor/graphics/world.hpp"
+
+static const int SEED = 7;
+static const unsigned int HEIGHT = 8; //chunks per column
+
+static int removeEntry(const char *path, const struct stat *, int, struct FTW *)
+{
+	return remove(path);
+}
+
+static void removeDirectory(const string &path)
+{
+	nftw(path.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+//the center of chunk column x, z
+static void streamTo(motor::World &world, int x, int z)
+{
+	world.stream(glm::vec3(x * 16 + 8, 0, z * 16 + 8), ~0u);
+}
+
+static void start(motor::World &world, unsigned int radius, const string &saveDirectory)
+{
+	world.load(radius, HEIGHT);
+	world.setHeadless(true);
+	world.setSaveDirectory(saveDirectory);
+	world.setSeed(SEED);
+}
+
+//chunks in the radius around x, z whose blocks differ; only chunks whose neighbors are generated in
+//both worlds get the same features, a world that went further has more at the border of the other
+static unsigned int compare(motor::World &a, motor::World &b, int x, int z, int radius)
+{
+	unsigned int differ = 0;
+	for(int cx = x - radius; cx <= x + radius; cx++)
+		for(int cz = z - radius; cz <= z + radius; cz++)
+		{
+			if((cx - x) * (cx - x) + (cz - z) * (cz - z) > radius * radius)
+				continue;
+			for(int cy = 0; cy < int(HEIGHT); cy++)
+			{
+				bool same = true;
+				for(int i = 0; i < 16 * 16 * 16 && same; i++)
+				{
+					int bx = cx * 16 + i / 256, by = cy * 16 + i / 16 % 16, bz = cz * 16 + i % 16;
+					same = a.getBlock(bx, by, bz).type == b.getBlock(bx, by, bz).type;
+				}
+				if(!same && differ++ < 10)
+					cout << "chunk " << cx << " " << cy << " " << cz << " differs" << endl;
+			}
+		}
+	return differ;
+}
+
+static bool oscillate()
+{
+	//every chunk at the far end is dropped and generated again on the way back
+	motor::World world;
+	start(world, 5, "");
+	world.setHysteresis(2);
+	unsigned int first = 0;
+	bool flat = true;
+	for(unsigned int cycle = 0; cycle < 4; cycle++)
+	{
+		for(int x = 0; x <= 8; x++)
+			streamTo(world, x, 0);
+		for(int x = 8; x >= 0; x--)
+			streamTo(world, x, 0);
+		unsigned int count = world.getPendingEditCount();
+		if(cycle == 0)
+			first = count;
+		flat = flat && count == first;
+		cout << "walking between chunk 0 and 8, cycle " << cycle << ": " << count << " pending edits" << endl;
+	}
+	return flat;
+}
+
+static bool continueSaved(const string &directory)
+{
+	//saved with a small radius, some of the features of the chunks at its border only wait in the
+	//pending edits for the chunks next to them
+	{
+		motor::World saved;
+		start(saved, 5, directory);
+		streamTo(saved, 0, 0);
+		for(int x = 0; x <= 40; x += 4)
+			streamTo(saved, x, 0);
+		saved.save();
+	}
+	{
+		motor::World saved;
+		start(saved, 5, directory);
+		streamTo(saved, 40, 0);
+		saved.stream(glm::vec3(40 * 16 + 8, 0, 16 * 16 + 8), 8); //part of it and then quit
+		saved.save();
+	}
+
+	motor::World continued, unsaved;
+	start(continued, 8, directory);
+	start(unsaved, 8, "");
+	unsigned int differ = 0;
+	int centers[][2] = {{0, 0}, {20, 0}, {40, 0}, {40, 16}};
+	for(unsigned int c = 0; c < 4; c++)
+	{
+		streamTo(continued, centers[c][0], centers[c][1]);
+		streamTo(unsaved, centers[c][0], centers[c][1]);
+		differ += compare(continued, unsaved, centers[c][0], centers[c][1], 8 - 2);
+	}
+	cout << "saved with a radius of 5 and continued with 8: " << differ << " chunks differ from a world without a save directory" << endl;
+	return differ == 0;
+}
+
+static bool continueSnapshot(const string &path, const string &saveDirectory)
+{
+	//taken right after a step, the chunks at the far side still wait for their neighbors
+	{
+		motor::World saved;
+		start(saved, 5, saveDirectory);
+		streamTo(saved, 0, 0);
+		saved.stream(glm::vec3(4 * 16 + 8, 0, 8), 8);
+		if(!saveDirectory.empty())
+			saved.save();
+		if(!saved.saveSnapshot(path))
+			return false;
+	}
+
+	motor::World continued, fresh;
+	start(continued, 5, saveDirectory);
+	if(!continued.loadSnapshot(path))
+		return false;
+	streamTo(continued, 4, 0);
+	start(fresh, 5, "");
+	streamTo(fresh, 4, 0);
+	unsigned int differ = compare(continued, fresh, 4, 0, 5 - 2);
+	cout << "continued from a snapshot taken while streaming" << (saveDirectory.empty() ? "" : " with a save directory") << ": " << differ << " chunks differ from a fresh world" << endl;
+	return differ == 0;
+}
+
+int main()
+{
+	char directory[] = "/tmp/featuresXXXXXX";
+	if(mkdtemp(directory) == NULL)
+	{
+		cout << "could not create a save directory" << endl;
+		return 1;
+	}
+	bool passed = oscillate();
+	passed = continueSaved(directory) && passed;
+	passed = continueSnapshot(string(directory) + "/snapshot", "") && passed;
+	passed = continueSnapshot(string(directory) + "/snapshot", string(directory) + "/snapshotSave") && passed;
+	removeDirectory(directory);
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,101 @@
+//checks Camera::extractFrustumPlanes and AABB::cullFrustum against projecting the corners of random boxes,
+//built once for every path of cullFrustum (see SConscript), exits with 1 if a box is culled wrongly
+#include <iostream>
+#include <vector>
+#include <stdint.h>
+using namespace std;
+
+#include "motor/graphics/camera.hpp"
+#include "motor/math/aabb.hpp"
+
+static const unsigned int BOXES = 100000;
+static const unsigned int CAMERAS = 16;
+
+//xorshift, the same boxes every run
+static uint32_t state = 2463534242u;
+static float uniform(float low, float high)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return low + (high - low) * (state >> 8) / float(1 << 24);
+}
+
+//1 if a corner is inside of the clip volume, 0 if all are outside of the same clip plane, -1 in between
+//or closer to a plane than rounding, where either answer is right
+static int project(const glm::mat4 &viewProjection, const float *const bounds[6], unsigned int n)
+{
+	unsigned int outsideAll = 0x3F;
+	bool insideAny = false;
+	for(unsigned int c = 0; c < 8; c++)
+	{
+		glm::vec4 corner = viewProjection * glm::vec4(bounds[c & 1 ? 3 : 0][n], bounds[c & 2 ? 4 : 1][n], bounds[c & 4 ? 5 : 2][n], 1.0f);
+		float margin = 1e-3f * fabs(corner.w) + 1e-3f;
+		unsigned int outside = 0, inside = 0x3F;
+		for(unsigned int a = 0; a < 3; a++)
+		{
+			if(corner[a] < -corner.w - margin) outside |= 1 << (a * 2);
+			if(corner[a] > corner.w + margin) outside |= 2 << (a * 2);
+			if(corner[a] < -corner.w + margin) inside &= ~(1 << (a * 2));
+			if(corner[a] > corner.w - margin) inside &= ~(2 << (a * 2));
+		}
+		outsideAll &= outside;
+		if(inside == 0x3F)
+			insideAny = true;
+	}
+	return insideAny ? 1 : outsideAll ? 0 : -1;
+}
+
+int main()
+{
+	vector<float> bounds[6];
+	vector<unsigned char> visible;
+	unsigned int wrong = 0, kept = 0, culled = 0;
+	for(unsigned int cam = 0; cam < CAMERAS; cam++)
+	{
+		glm::vec3 eye(uniform(-100, 100), uniform(-100, 100), uniform(-100, 100));
+		glm::vec3 target = eye + glm::vec3(uniform(-1, 1), uniform(-1, 1), uniform(-1, 1));
+		float far = uniform(50, 300);
+		glm::mat4 viewProjection = glm::perspective(uniform(30, 110), uniform(0.5f, 2), uniform(0.1f, 1), far) * glm::lookAt(eye, target, glm::vec3(0, 1, 0));
+		glm::vec4 planes[6];
+		motor::Camera::extractFrustumPlanes(viewProjection, planes);
+
+		//a count that is no multiple of the vector width, so the scalar tail runs as well
+		unsigned int count = BOXES / CAMERAS + cam;
+		for(unsigned int b = 0; b < 6; b++)
+			bounds[b].resize(count);
+		for(unsigned int n = 0; n < count; n++)
+			for(unsigned int a = 0; a < 3; a++)
+			{
+				float min = eye[a] + uniform(-far, far);
+				bounds[a][n] = min;
+				bounds[a + 3][n] = min + uniform(0, 0.25f * far);
+			}
+		const float *pointers[6];
+		for(unsigned int b = 0; b < 6; b++)
+			pointers[b] = &bounds[b][0];
+		visible.assign(count, 2);
+		motor::AABB::cullFrustum(pointers, count, planes, &visible[0]);
+
+		for(unsigned int n = 0; n < count; n++)
+		{
+			int expected = project(viewProjection, pointers, n);
+			if(visible[n] > 1 || (expected >= 0 && visible[n] != expected))
+			{
+				if(wrong++ < 10)
+					cout << "camera " << cam << ", box " << n << ": " << (visible[n] ? "kept" : "culled") << ", the projected corners say otherwise" << endl;
+			}
+			if(expected >= 0)
+				(expected ? kept : culled)++;
+		}
+	}
+#if defined(__AVX__)
+	cout << "avx: ";
+#elif defined(__SSE2__)
+	cout << "sse2: ";
+#else
+	cout << "scalar: ";
+#endif
+	cout << kept << " boxes kept, " << culled << " culled, " << wrong << " wrong" << endl;
+	return wrong ? 1 : 0;
+}